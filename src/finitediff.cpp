@@ -3,154 +3,434 @@
 // and rewritten to use Eigen
 #include "finitediff.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
 #include <vector>
 
 #include <spdlog/spdlog.h>
 
 namespace fd {
 
-// The external coefficients, c1, in c1 * f(x + c2).
-// See: https://en.wikipedia.org/wiki/Finite_difference_coefficient
-std::vector<double> get_external_coeffs(const AccuracyOrder accuracy)
+namespace {
+
+// Number of columns in each batch of perturbed points. A maximum batch size of
+// zero means all points are evaluated in a single batch.
+size_t resolve_batch_size(const size_t max_batch_size, const size_t num_points)
 {
-    switch (accuracy) {
-    case SECOND:
-        return { { 1, -1 } };
-    case FOURTH:
-        return { { 1, -8, 8, -1 } };
-    case SIXTH:
-        return { { -1, 9, -45, 45, -9, 1 } };
-    case EIGHTH:
-        return { { 3, -32, 168, -672, 672, -168, 32, -3 } };
-    default:
-        throw std::invalid_argument("invalid accuracy order");
+    if (max_batch_size == 0) {
+        return std::max<size_t>(num_points, 1);
     }
+    return std::max<size_t>(std::min(max_batch_size, num_points), 1);
 }
 
-// The internal coefficients, c2, in c1 * f(x + c2).
-// See: https://en.wikipedia.org/wiki/Finite_difference_coefficient
-std::vector<double> get_interior_coeffs(const AccuracyOrder accuracy)
+// View the compile-time coefficients of a stencil.
+template <typename S> StencilCoeffs make_stencil_coeffs()
 {
-    switch (accuracy) {
-    case SECOND:
-        return { { 1, -1 } };
-    case FOURTH:
-        return { { -2, -1, 1, 2 } };
-    case SIXTH:
-        return { { -3, -2, -1, 1, 2, 3 } };
-    case EIGHTH:
-        return { { -4, -3, -2, -1, 1, 2, 3, 4 } };
-    default:
-        throw std::invalid_argument("invalid accuracy order");
+    StencilCoeffs stencil;
+    stencil.size = S::size;
+    stencil.external_coeffs = S::external_coeffs;
+    stencil.internal_coeffs = S::internal_coeffs;
+    stencil.denominator = S::denominator;
+    return stencil;
+}
+
+// Weights of the stencil along the diagonal of the hessian, indexed by offset
+// (see internal::diagonal_stencil_weights).
+std::vector<double> diagonal_weights(const StencilCoeffs& stencil)
+{
+    std::vector<double> weights(2 * stencil.size + 1);
+    internal::diagonal_stencil_weights(
+        stencil.size, stencil.external_coeffs, stencil.internal_coeffs,
+        weights.data());
+    return weights;
+}
+
+// Number of points with a nonzero weight on the diagonal, excluding x itself.
+size_t num_diagonal_points(const std::vector<double>& weights)
+{
+    const size_t center = weights.size() / 2;
+    size_t count = 0;
+    for (size_t o = 0; o < weights.size(); o++) {
+        if (o != center && weights[o] != 0) {
+            count++;
+        }
     }
+    return count;
 }
 
-// The denominators of the finite difference.
-double get_denominator(const AccuracyOrder accuracy)
+} // namespace
+
+// Get the stencil of the given accuracy order.
+StencilCoeffs get_stencil(const AccuracyOrder accuracy)
 {
     switch (accuracy) {
     case SECOND:
-        return 2;
+        return make_stencil_coeffs<internal::Stencil<SECOND>>();
     case FOURTH:
-        return 12;
+        return make_stencil_coeffs<internal::Stencil<FOURTH>>();
     case SIXTH:
-        return 60;
+        return make_stencil_coeffs<internal::Stencil<SIXTH>>();
     case EIGHTH:
-        return 840;
+        return make_stencil_coeffs<internal::Stencil<EIGHTH>>();
     default:
         throw std::invalid_argument("invalid accuracy order");
     }
 }
 
+size_t finite_hessian_num_evaluations(
+    const Eigen::Index n,
+    const AccuracyOrder accuracy,
+    const HessianStencil stencil)
+{
+    const StencilCoeffs coeffs = get_stencil(accuracy);
+    const size_t num_off_diagonal = size_t(n) * size_t(n - 1) / 2;
+
+    if (stencil == REDUCED_STENCIL) {
+        return num_off_diagonal * 2 * coeffs.size + size_t(n) * coeffs.size
+            + (n > 0 ? 1 : 0);
+    }
+
+    const std::vector<double> weights = diagonal_weights(coeffs);
+    return num_off_diagonal * coeffs.size * coeffs.size
+        + size_t(n) * num_diagonal_points(weights)
+        + (n > 0 && weights[coeffs.size] != 0 ? 1 : 0);
+}
+
+Workspace::Workspace(const Eigen::Index n, const unsigned num_threads)
+{
+    perturbation_buffers(n, num_threads);
+}
+
+Eigen::VectorXd* Workspace::perturbation_buffers(
+    const Eigen::Index n, const unsigned num_threads)
+{
+    assert(num_threads > 0);
+    if (m_x_buffers.size() < num_threads) {
+        m_x_buffers.resize(num_threads);
+    }
+    for (unsigned t = 0; t < num_threads; t++) {
+        m_x_buffers[t].resize(n); // No-op if already of size n
+    }
+    return m_x_buffers.data();
+}
+
+Eigen::VectorXd*
+Workspace::output_buffers(const Eigen::Index m, const unsigned num_threads)
+{
+    assert(num_threads > 0);
+    if (m_fx_buffers.size() < num_threads) {
+        m_fx_buffers.resize(num_threads);
+    }
+    for (unsigned t = 0; t < num_threads; t++) {
+        m_fx_buffers[t].resize(m); // No-op if already of size m
+    }
+    return m_fx_buffers.data();
+}
+
+StepSize::StepSize(
+    const Policy policy, const double value, const Eigen::VectorXd& coordinates)
+    : m_policy(policy)
+    , m_value(value)
+    , m_coordinates(coordinates)
+{
+}
+
+StepSize StepSize::absolute(const double eps)
+{
+    assert(eps > 0);
+    return StepSize(ABSOLUTE, eps, Eigen::VectorXd());
+}
+
+StepSize StepSize::relative(const double eps, const Eigen::VectorXd& typical_x)
+{
+    assert(eps > 0 && (typical_x.array() != 0).all());
+    return StepSize(RELATIVE, eps, typical_x);
+}
+
+StepSize StepSize::per_coordinate(const Eigen::VectorXd& steps)
+{
+    assert((steps.array() > 0).all());
+    return StepSize(PER_COORDINATE, 0, steps);
+}
+
+StepSize StepSize::optimal(const double noise, const Eigen::VectorXd& typical_x)
+{
+    assert(noise > 0 && (typical_x.array() != 0).all());
+    return StepSize(OPTIMAL, noise, typical_x);
+}
+
+Eigen::VectorXd StepSize::steps(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const AccuracyOrder accuracy,
+    const int derivative_order) const
+{
+    if (m_policy == ABSOLUTE) {
+        return Eigen::VectorXd::Constant(x.size(), m_value);
+    }
+    if (m_policy == PER_COORDINATE) {
+        assert(m_coordinates.size() == x.size());
+        return m_coordinates;
+    }
+
+    // max(|xᵢ|, typical_xᵢ), with typical magnitudes of one by default.
+    Eigen::VectorXd magnitude = x.cwiseAbs();
+    if (m_coordinates.size() == 0) {
+        magnitude = magnitude.cwiseMax(1.0);
+    } else {
+        assert(m_coordinates.size() == x.size());
+        magnitude = magnitude.cwiseMax(m_coordinates.cwiseAbs());
+    }
+
+    double eps = m_value;
+    if (m_policy == OPTIMAL) {
+        // The order of accuracy is the number of points in the stencil.
+        const double order = double(get_stencil(accuracy).size);
+        eps = std::pow(m_value, 1 / (order + derivative_order));
+    }
+    return eps * magnitude;
+}
+
 // Compute the gradient of a function at a point using finite differences.
 void finite_gradient(
     const Eigen::Ref<const Eigen::VectorXd>& x,
     const std::function<double(const Eigen::VectorXd&)>& f,
     Eigen::VectorXd& grad,
     const AccuracyOrder accuracy,
-    const double eps)
+    const double eps,
+    const unsigned num_threads)
 {
-    const std::vector<double> external_coeffs = get_external_coeffs(accuracy);
-    const std::vector<double> internal_coeffs = get_interior_coeffs(accuracy);
+    finite_gradient<std::function<double(const Eigen::VectorXd&)>>(
+        x, f, grad, accuracy, eps, num_threads);
+}
 
-    assert(external_coeffs.size() == internal_coeffs.size());
-    const size_t inner_steps = internal_coeffs.size();
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<Eigen::VectorXd(const Eigen::VectorXd&)>& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads)
+{
+    finite_jacobian<std::function<Eigen::VectorXd(const Eigen::VectorXd&)>>(
+        x, f, jac, accuracy, eps, num_threads);
+}
 
-    const double denom = get_denominator(accuracy) * eps;
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<double(const Eigen::VectorXd&)>& f,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads,
+    const HessianStencil stencil)
+{
+    finite_hessian<std::function<double(const Eigen::VectorXd&)>>(
+        x, f, hess, accuracy, eps, num_threads, stencil);
+}
+
+// Compute the gradient of a function at a point using finite differences,
+// evaluating the perturbed points in batches.
+void finite_gradient_batched(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<Eigen::VectorXd(const Eigen::MatrixXd&)>& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const size_t max_batch_size)
+{
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    const double* external_coeffs = stencil.external_coeffs;
+    const double* internal_coeffs = stencil.internal_coeffs;
+    const size_t inner_steps = stencil.size;
+
+    const double denom = stencil.denominator * eps;
 
     grad.setZero(x.rows());
 
-    Eigen::VectorXd x_mutable = x;
-    for (size_t i = 0; i < x.rows(); i++) {
-        for (size_t ci = 0; ci < inner_steps; ci++) {
-            x_mutable[i] += internal_coeffs[ci] * eps;
-            grad[i] += external_coeffs[ci] * f(x_mutable);
-            x_mutable[i] = x[i];
+    // Point p perturbs coordinate p / inner_steps by stencil step
+    // p % inner_steps.
+    const size_t num_points = x.rows() * inner_steps;
+    const size_t batch_size = resolve_batch_size(max_batch_size, num_points);
+
+    Eigen::MatrixXd X;
+    for (size_t start = 0; start < num_points; start += batch_size) {
+        const size_t count = std::min(batch_size, num_points - start);
+
+        X.resize(x.rows(), count);
+        for (size_t b = 0; b < count; b++) {
+            const size_t i = (start + b) / inner_steps;
+            const size_t ci = (start + b) % inner_steps;
+            X.col(b) = x;
+            X(i, b) += internal_coeffs[ci] * eps;
+        }
+
+        const Eigen::VectorXd values = f(X);
+        assert(size_t(values.size()) == count);
+
+        for (size_t b = 0; b < count; b++) {
+            const size_t i = (start + b) / inner_steps;
+            const size_t ci = (start + b) % inner_steps;
+            grad[i] += external_coeffs[ci] * values[b];
         }
-        grad[i] /= denom;
     }
+
+    grad /= denom;
 }
 
-void finite_jacobian(
+void finite_jacobian_batched(
     const Eigen::Ref<const Eigen::VectorXd>& x,
-    const std::function<Eigen::VectorXd(const Eigen::VectorXd&)>& f,
+    const std::function<Eigen::MatrixXd(const Eigen::MatrixXd&)>& f,
     Eigen::MatrixXd& jac,
     const AccuracyOrder accuracy,
-    const double eps)
+    const double eps,
+    const size_t max_batch_size)
 {
-    const std::vector<double> external_coeffs = get_external_coeffs(accuracy);
-    const std::vector<double> internal_coeffs = get_interior_coeffs(accuracy);
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    const double* external_coeffs = stencil.external_coeffs;
+    const double* internal_coeffs = stencil.internal_coeffs;
+    const size_t inner_steps = stencil.size;
+
+    const double denom = stencil.denominator * eps;
+
+    const size_t num_points = x.rows() * inner_steps;
+    const size_t batch_size = resolve_batch_size(max_batch_size, num_points);
 
-    assert(external_coeffs.size() == internal_coeffs.size());
-    const size_t inner_steps = internal_coeffs.size();
+    if (num_points == 0) {
+        jac.setZero(f(x).rows(), 0);
+        return;
+    }
+
+    Eigen::MatrixXd X;
+    for (size_t start = 0; start < num_points; start += batch_size) {
+        const size_t count = std::min(batch_size, num_points - start);
+
+        X.resize(x.rows(), count);
+        for (size_t b = 0; b < count; b++) {
+            const size_t i = (start + b) / inner_steps;
+            const size_t ci = (start + b) % inner_steps;
+            X.col(b) = x;
+            X(i, b) += internal_coeffs[ci] * eps;
+        }
 
-    const double denom = get_denominator(accuracy) * eps;
+        const Eigen::MatrixXd values = f(X);
+        assert(size_t(values.cols()) == count);
 
-    jac.setZero(f(x).rows(), x.rows());
+        // The first batch determines the number of rows of the jacobian.
+        if (start == 0) {
+            jac.setZero(values.rows(), x.rows());
+        }
 
-    Eigen::VectorXd x_mutable = x;
-    for (size_t i = 0; i < x.rows(); i++) {
-        for (size_t ci = 0; ci < inner_steps; ci++) {
-            x_mutable[i] += internal_coeffs[ci] * eps;
-            jac.col(i) += external_coeffs[ci] * f(x_mutable);
-            x_mutable[i] = x[i];
+        for (size_t b = 0; b < count; b++) {
+            const size_t i = (start + b) / inner_steps;
+            const size_t ci = (start + b) % inner_steps;
+            jac.col(i) += external_coeffs[ci] * values.col(b);
         }
-        jac.col(i) /= denom;
     }
+
+    jac /= denom;
 }
 
-void finite_hessian(
+void finite_hessian_batched(
     const Eigen::Ref<const Eigen::VectorXd>& x,
-    const std::function<double(const Eigen::VectorXd&)>& f,
+    const std::function<Eigen::VectorXd(const Eigen::MatrixXd&)>& f,
     Eigen::MatrixXd& hess,
     const AccuracyOrder accuracy,
-    const double eps)
+    const double eps,
+    const size_t max_batch_size)
 {
-    const std::vector<double> external_coeffs = get_external_coeffs(accuracy);
-    const std::vector<double> internal_coeffs = get_interior_coeffs(accuracy);
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    const double* external_coeffs = stencil.external_coeffs;
+    const double* internal_coeffs = stencil.internal_coeffs;
+    const size_t inner_steps = stencil.size;
 
-    assert(external_coeffs.size() == internal_coeffs.size());
-    const size_t inner_steps = internal_coeffs.size();
-
-    double denom = get_denominator(accuracy) * eps;
+    double denom = stencil.denominator * eps;
     denom *= denom;
 
     hess.setZero(x.rows(), x.rows());
 
-    Eigen::VectorXd x_mutable = x;
-    for (size_t i = 0; i < x.rows(); i++) {
-        for (size_t j = i; j < x.rows(); j++) {
+    const size_t n = x.rows();
+    if (n == 0) {
+        return;
+    }
+
+    // Repeated points on the diagonal are evaluated once with their summed
+    // weights, as in finite_hessian().
+    const std::vector<double> diag_weights = diagonal_weights(stencil);
+    const size_t center = inner_steps;
+
+    // x itself is shared by the whole diagonal, so evaluate it up front.
+    if (diag_weights[center] != 0) {
+        const double f_center = f(x)[0];
+        hess.diagonal().setConstant(diag_weights[center] * f_center);
+    }
+
+    const size_t num_points = n * (n - 1) / 2 * inner_steps * inner_steps
+        + n * num_diagonal_points(diag_weights);
+    const size_t batch_size = resolve_batch_size(max_batch_size, num_points);
+
+    // Entry of the hessian and stencil weight of each column in the batch.
+    std::vector<std::array<size_t, 2>> entries;
+    std::vector<double> weights;
+    entries.reserve(batch_size);
+    weights.reserve(batch_size);
+
+    Eigen::MatrixXd X(n, std::min(batch_size, num_points));
+    const auto flush = [&]() {
+        if (entries.empty()) {
+            return;
+        }
+        if (size_t(X.cols()) != entries.size()) {
+            X.conservativeResize(n, entries.size());
+        }
+
+        const Eigen::VectorXd values = f(X);
+        assert(size_t(values.size()) == entries.size());
+
+        for (size_t b = 0; b < entries.size(); b++) {
+            hess(entries[b][0], entries[b][1]) += weights[b] * values[b];
+        }
+        entries.clear();
+        weights.clear();
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t o = 0; o < diag_weights.size(); o++) {
+            if (o == center || diag_weights[o] == 0) {
+                continue;
+            }
+            const size_t b = entries.size();
+            X.col(b) = x;
+            X(i, b) += (double(o) - double(center)) * eps;
+            entries.push_back({ { i, i } });
+            weights.push_back(diag_weights[o]);
+            if (entries.size() == batch_size) {
+                flush();
+            }
+        }
+        for (size_t j = i + 1; j < n; j++) {
             for (size_t ci = 0; ci < inner_steps; ci++) {
                 for (size_t cj = 0; cj < inner_steps; cj++) {
-                    x_mutable[i] += internal_coeffs[ci] * eps;
-                    x_mutable[j] += internal_coeffs[cj] * eps;
-                    hess(i, j) += external_coeffs[ci] * external_coeffs[cj]
-                        * f(x_mutable);
-                    x_mutable[j] = x[j];
-                    x_mutable[i] = x[i];
+                    const size_t b = entries.size();
+                    X.col(b) = x;
+                    X(i, b) += internal_coeffs[ci] * eps;
+                    X(j, b) += internal_coeffs[cj] * eps;
+                    entries.push_back({ { i, j } });
+                    weights.push_back(
+                        external_coeffs[ci] * external_coeffs[cj]);
+                    if (entries.size() == batch_size) {
+                        flush();
+                    }
                 }
             }
+        }
+    }
+    flush();
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i; j < n; j++) {
             hess(i, j) /= denom;
             hess(j, i) = hess(i, j); // The hessian is symmetric
         }
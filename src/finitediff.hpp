@@ -6,6 +6,12 @@
  */
 #pragma once
 
+#include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 #include <Eigen/Core>
 
 namespace fd {
@@ -22,53 +28,1038 @@ enum AccuracyOrder {
     EIGHTH  ///< @brief Eighth order accuracy.
 };
 
+/**
+ * @brief Enumeration of the stencils available for the hessian.
+ */
+enum HessianStencil {
+    /// @brief Tensor product of the first derivative stencil with itself:
+    ///        k² points per off-diagonal entry, where k is the number of
+    ///        points in the first derivative stencil.
+    FULL_STENCIL,
+    /// @brief Central second derivative stencils on the diagonal and
+    ///        Richardson-extrapolated four point cross stencils off the
+    ///        diagonal: 2k points per off-diagonal entry for the same order of
+    ///        accuracy.
+    REDUCED_STENCIL
+};
+
+/**
+ * @brief Coefficients of a central finite difference stencil.
+ *
+ * The derivative of f at x is approximated by
+ *     Σᵢ external_coeffs[i] * f(x + internal_coeffs[i] * eps)
+ * divided by denominator * eps.
+ * See: https://en.wikipedia.org/wiki/Finite_difference_coefficient
+ */
+struct StencilCoeffs {
+    /// @brief Number of points in the stencil.
+    size_t size;
+    /// @brief The external coefficients, c1, in c1 * f(x + c2).
+    const double* external_coeffs;
+    /// @brief The internal coefficients, c2, in c1 * f(x + c2).
+    const double* internal_coeffs;
+    /// @brief The denominator of the finite difference.
+    double denominator;
+};
+
+/**
+ * @brief Get the stencil of an accuracy order.
+ *
+ * The coefficients point into compile-time tables, so this does not allocate.
+ *
+ * @param[in] accuracy  Accuracy of the finite differences.
+ *
+ * @return The coefficients of the stencil.
+ */
+StencilCoeffs get_stencil(const AccuracyOrder accuracy);
+
+/**
+ * @brief Scratch buffers reused across finite difference calls.
+ *
+ * Passing the same workspace to repeated calls with the same number of
+ * variables (and threads) reuses the perturbed points instead of allocating
+ * them on every call. The stencil coefficients are compile-time constants and
+ * need no storage. A workspace must not be shared by concurrent calls.
+ */
+class Workspace {
+public:
+    Workspace() = default;
+
+    /**
+     * @brief Construct a workspace with buffers preallocated.
+     *
+     * @param[in] n            Number of variables.
+     * @param[in] num_threads  Number of threads (resolved, i.e. not 0).
+     */
+    explicit Workspace(const Eigen::Index n, const unsigned num_threads = 1);
+
+    /**
+     * @brief Get the perturbation buffers, resizing them if needed.
+     *
+     * @param[in] n            Number of variables.
+     * @param[in] num_threads  Number of threads (resolved, i.e. not 0).
+     *
+     * @return Pointer to num_threads vectors of size n.
+     */
+    Eigen::VectorXd*
+    perturbation_buffers(const Eigen::Index n, const unsigned num_threads = 1);
+
+    /**
+     * @brief Get the output buffers of in-place functions, resizing them if
+     *        needed.
+     *
+     * @param[in] m            Number of outputs.
+     * @param[in] num_threads  Number of threads (resolved, i.e. not 0).
+     *
+     * @return Pointer to num_threads vectors of size m.
+     */
+    Eigen::VectorXd*
+    output_buffers(const Eigen::Index m, const unsigned num_threads = 1);
+
+protected:
+    /// @brief One perturbation vector per thread.
+    std::vector<Eigen::VectorXd> m_x_buffers;
+    /// @brief One output vector per thread.
+    std::vector<Eigen::VectorXd> m_fx_buffers;
+};
+
+/**
+ * @brief Policy choosing the finite difference step of each coordinate.
+ *
+ * A single absolute eps suits coordinates of magnitude about one, but is lost
+ * in the round-off of large coordinates and swamps small ones. A step size
+ * policy gives each coordinate its own step instead.
+ */
+class StepSize {
+public:
+    /**
+     * @brief The same step for every coordinate, as with a plain eps.
+     *
+     * @param[in] eps  Value of the finite difference step.
+     */
+    static StepSize absolute(const double eps);
+
+    /**
+     * @brief Steps eps max(|xᵢ|, typical_xᵢ), relative to the magnitude of
+     *        each coordinate.
+     *
+     * @param[in] eps        Relative value of the finite difference step.
+     * @param[in] typical_x  Nonzero typical magnitude of each coordinate,
+     *                       bounding the steps of coordinates near zero
+     *                       (empty for all ones).
+     */
+    static StepSize relative(
+        const double eps, const Eigen::VectorXd& typical_x = Eigen::VectorXd());
+
+    /**
+     * @brief User-supplied steps.
+     *
+     * @param[in] steps  Positive step of each coordinate.
+     */
+    static StepSize per_coordinate(const Eigen::VectorXd& steps);
+
+    /**
+     * @brief Steps balancing the truncation and round-off errors.
+     *
+     * The error of a central difference of order p for a derivative of order
+     * d is about C₁ hᵖ + C₂ noise / hᵈ, which is minimal for h of the order
+     * of noise^(1 / (p + d)). The steps are noise^(1 / (p + d))
+     * max(|xᵢ|, typical_xᵢ).
+     *
+     * @param[in] noise      Relative error of the values of f (machine
+     *                       epsilon if f is accurate to working precision).
+     * @param[in] typical_x  Nonzero typical magnitude of each coordinate
+     *                       (empty for all ones).
+     */
+    static StepSize optimal(
+        const double noise = std::numeric_limits<double>::epsilon(),
+        const Eigen::VectorXd& typical_x = Eigen::VectorXd());
+
+    /**
+     * @brief Compute the step of each coordinate.
+     *
+     * @param[in] x                 Point at which the derivative is computed.
+     * @param[in] accuracy          Accuracy of the finite differences.
+     * @param[in] derivative_order  Order of the derivative (1 for gradients
+     *                              and jacobians, 2 for hessians).
+     *
+     * @return The step of each coordinate.
+     */
+    Eigen::VectorXd steps(
+        const Eigen::Ref<const Eigen::VectorXd>& x,
+        const AccuracyOrder accuracy,
+        const int derivative_order) const;
+
+protected:
+    enum Policy { ABSOLUTE, RELATIVE, PER_COORDINATE, OPTIMAL };
+
+    StepSize(
+        const Policy policy,
+        const double value,
+        const Eigen::VectorXd& coordinates);
+
+    Policy m_policy;
+    /// @brief eps of absolute and relative steps, or noise of optimal steps.
+    double m_value;
+    /// @brief Typical magnitudes of the coordinates, or per coordinate steps.
+    Eigen::VectorXd m_coordinates;
+};
+
 /**
  * @brief Compute the gradient of a function using finite differences.
  *
+ * @param[in]  x            Point at which to compute the gradient.
+ * @param[in]  f            Compute the gradient of this function.
+ * @param[out] grad         Computed gradient.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the coordinates across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<double(const Eigen::VectorXd&)>& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function using finite differences.
+ *
+ * @param[in]  x            Point at which to compute the jacobian.
+ * @param[in]  f            Compute the jacobian of this function.
+ * @param[out] jac          Computed jacobian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the columns across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<Eigen::VectorXd(const Eigen::VectorXd&)>& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1);
+
+/**
+ * @brief Compute the hessian of a function using finite differences.
+ *
+ * @param[in]  x            Point at which to compute the hessian.
+ * @param[in]  f            Compute the hessian of this function.
+ * @param[out] hess         Computed hessian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to share the entries of the upper
+ *                          triangle (0 uses all hardware threads). If not 1, f
+ *                          must be safe to call concurrently.
+ * @param[in]  stencil      Stencil used for the entries.
+ */
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<double(const Eigen::VectorXd&)>& f,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    const unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Count the evaluations of f performed by finite_hessian().
+ *
+ * On the diagonal, the stencil pairs (ci, cj) and (cj, ci), and more
+ * generally all pairs with the same cᵢ + cⱼ, land on the same point, and every
+ * pair with cᵢ + cⱼ = 0 lands on x. These points are evaluated only once, so
+ * this is less than the n (n + 1) / 2 k² evaluations of the full stencil,
+ * where k is the number of points in the stencil. The reduced stencil uses
+ * 2k evaluations per off-diagonal entry, k per diagonal entry, and f(x).
+ *
+ * @param[in] n         Number of variables.
+ * @param[in] accuracy  Accuracy of the finite differences.
+ * @param[in] stencil   Stencil used for the entries.
+ * @return Number of evaluations of f.
+ */
+size_t finite_hessian_num_evaluations(
+    const Eigen::Index n,
+    const AccuracyOrder accuracy = SECOND,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the gradient of a function using finite differences.
+ *
+ * Templated on the function type so cheap functions can be inlined.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the gradient.
+ * @param[in]  f            Compute the gradient of this function.
+ * @param[out] grad         Computed gradient.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the coordinates across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+template <typename Function>
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function using finite differences.
+ *
+ * Templated on the function type so cheap functions can be inlined.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the jacobian.
+ * @param[in]  f            Compute the jacobian of this function.
+ * @param[out] jac          Computed jacobian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the columns across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1);
+
+/**
+ * @brief Compute the hessian of a function using finite differences.
+ *
+ * Templated on the function type so cheap functions can be inlined.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the hessian.
+ * @param[in]  f            Compute the hessian of this function.
+ * @param[out] hess         Computed hessian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to share the entries of the upper
+ *                          triangle (0 uses all hardware threads). If not 1, f
+ *                          must be safe to call concurrently.
+ * @param[in]  stencil      Stencil used for the entries.
+ */
+template <typename Function>
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    const unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the gradient of a function using finite differences, reusing
+ *        the buffers of a workspace.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]     x            Point at which to compute the gradient.
+ * @param[in]     f            Compute the gradient of this function.
+ * @param[out]    grad         Computed gradient.
+ * @param[in,out] workspace    Scratch buffers reused across calls.
+ * @param[in]     accuracy     Accuracy of the finite differences.
+ * @param[in]     eps          Value of the finite difference step.
+ * @param[in]     num_threads  Number of threads to split the coordinates
+ *                             across (0 uses all hardware threads). If not 1,
+ *                             f must be safe to call concurrently.
+ */
+template <typename Function>
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    Workspace& workspace,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function that writes its value into an
+ *        output buffer using finite differences.
+ *
+ * f is called as f(x, out) with out of size output_size, so no evaluation
+ * allocates a new vector.
+ *
+ * @tparam Function  Callable as
+ *                   void(const Eigen::VectorXd&, Eigen::Ref<Eigen::VectorXd>).
+ * @param[in]  x            Point at which to compute the jacobian.
+ * @param[in]  f            Compute the jacobian of this function.
+ * @param[in]  output_size  Number of outputs of f.
+ * @param[out] jac          Computed jacobian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the columns across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Index output_size,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function that writes its value into an
+ *        output buffer using finite differences, reusing the buffers of a
+ *        workspace.
+ *
+ * Once the workspace and jac are sized, this performs no heap allocation.
+ *
+ * @tparam Function  Callable as
+ *                   void(const Eigen::VectorXd&, Eigen::Ref<Eigen::VectorXd>).
+ * @param[in]     x            Point at which to compute the jacobian.
+ * @param[in]     f            Compute the jacobian of this function.
+ * @param[in]     output_size  Number of outputs of f.
+ * @param[out]    jac          Computed jacobian.
+ * @param[in,out] workspace    Scratch buffers reused across calls.
+ * @param[in]     accuracy     Accuracy of the finite differences.
+ * @param[in]     eps          Value of the finite difference step.
+ * @param[in]     num_threads  Number of threads to split the columns across
+ *                             (0 uses all hardware threads). If not 1, f must
+ *                             be safe to call concurrently.
+ */
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Index output_size,
+    Eigen::MatrixXd& jac,
+    Workspace& workspace,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function and its value at x using finite
+ *        differences.
+ *
+ * The value at x is not part of the central difference stencils, so this
+ * costs one more evaluation than finite_jacobian(), which only evaluates f at
+ * the stencil points. Use it when f(x) is needed anyway.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the jacobian.
+ * @param[in]  f            Compute the jacobian of this function.
+ * @param[out] jac          Computed jacobian.
+ * @param[out] fx           Value of f at x.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the columns across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    Eigen::VectorXd& fx,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function using finite differences, reusing
+ *        the buffers of a workspace.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]     x            Point at which to compute the jacobian.
+ * @param[in]     f            Compute the jacobian of this function.
+ * @param[out]    jac          Computed jacobian.
+ * @param[in,out] workspace    Scratch buffers reused across calls.
+ * @param[in]     accuracy     Accuracy of the finite differences.
+ * @param[in]     eps          Value of the finite difference step.
+ * @param[in]     num_threads  Number of threads to split the columns across
+ *                             (0 uses all hardware threads). If not 1, f must
+ *                             be safe to call concurrently.
+ */
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    Workspace& workspace,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the hessian of a function using finite differences, reusing
+ *        the buffers of a workspace.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]     x            Point at which to compute the hessian.
+ * @param[in]     f            Compute the hessian of this function.
+ * @param[out]    hess         Computed hessian.
+ * @param[in,out] workspace    Scratch buffers reused across calls.
+ * @param[in]     accuracy     Accuracy of the finite differences.
+ * @param[in]     eps          Value of the finite difference step.
+ * @param[in]     num_threads  Number of threads to share the entries of the
+ *                             upper triangle (0 uses all hardware threads). If
+ *                             not 1, f must be safe to call concurrently.
+ * @param[in]     stencil      Stencil used for the entries.
+ */
+template <typename Function>
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    Workspace& workspace,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the gradient of a function using finite differences with a
+ *        step per coordinate.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the gradient.
+ * @param[in]  f            Compute the gradient of this function.
+ * @param[out] grad         Computed gradient.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  step         Policy choosing the step of each coordinate.
+ * @param[in]  num_threads  Number of threads to share the coordinates (0 uses
+ *                          all hardware threads). If not 1, f must be safe to
+ *                          call concurrently.
+ */
+template <typename Function>
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy,
+    const StepSize& step,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function using finite differences with a
+ *        step per coordinate.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the jacobian.
+ * @param[in]  f            Compute the jacobian of this function.
+ * @param[out] jac          Computed jacobian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  step         Policy choosing the step of each coordinate.
+ * @param[in]  num_threads  Number of threads to share the columns (0 uses all
+ *                          hardware threads). If not 1, f must be safe to
+ *                          call concurrently.
+ */
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy,
+    const StepSize& step,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the hessian of a function using finite differences with a
+ *        step per coordinate.
+ *
+ * The entry (i, j) uses the steps of coordinates i and j.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the hessian.
+ * @param[in]  f            Compute the hessian of this function.
+ * @param[out] hess         Computed hessian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  step         Policy choosing the step of each coordinate.
+ * @param[in]  num_threads  Number of threads to share the entries of the upper
+ *                          triangle (0 uses all hardware threads). If not 1, f
+ *                          must be safe to call concurrently.
+ * @param[in]  stencil      Stencil used for the entries.
+ */
+template <typename Function>
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy,
+    const StepSize& step,
+    unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the gradient of a function using Richardson extrapolation of
+ *        central differences, with an estimate of the error of each entry.
+ *
+ * Central differences at the steps h, h / 1.4, h / 1.4², ... of each
+ * coordinate are extrapolated to a zero step in a Neville tableau (Ridders'
+ * method). Each new step costs two evaluations of f and extends the tableau
+ * by a row, reusing all previous rows. The entry with the smallest error
+ * estimate, the change from the neighbouring entries of the tableau, is
+ * kept. A coordinate stops early once the last extrapolation is worse than
+ * twice the best error, since round-off then dominates, or once its error is
+ * within the tolerance.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x             Point at which to compute the gradient.
+ * @param[in]  f             Compute the gradient of this function.
+ * @param[out] grad          Computed gradient.
+ * @param[out] error         Estimated absolute error of each entry.
+ * @param[in]  initial_step  Policy choosing the largest step of each
+ *                           coordinate, which should be large enough for f to
+ *                           change significantly.
+ * @param[in]  max_steps     Maximum number of steps per coordinate.
+ * @param[in]  tolerance     Error at which a coordinate stops (0 to stop only
+ *                           when round-off dominates).
+ * @param[in]  num_threads   Number of threads to share the coordinates (0 uses
+ *                           all hardware threads). If not 1, f must be safe
+ *                           to call concurrently.
+ */
+template <typename Function>
+void finite_gradient_extrapolated(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    Eigen::VectorXd& error,
+    const StepSize& initial_step = StepSize::relative(0.1),
+    const int max_steps = 10,
+    const double tolerance = 0,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the jacobian of a function using Richardson extrapolation of
+ *        central differences, with an estimate of the error of each entry.
+ *
+ * See finite_gradient_extrapolated(). The entries of a column share the
+ * evaluations of f, and the column stops once every entry would stop.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x             Point at which to compute the jacobian.
+ * @param[in]  f             Compute the jacobian of this function.
+ * @param[out] jac           Computed jacobian.
+ * @param[out] error         Estimated absolute error of each entry.
+ * @param[in]  initial_step  Policy choosing the largest step of each
+ *                           coordinate.
+ * @param[in]  max_steps     Maximum number of steps per coordinate.
+ * @param[in]  tolerance     Error at which a column stops (0 to stop only when
+ *                           round-off dominates).
+ * @param[in]  num_threads   Number of threads to share the columns (0 uses all
+ *                           hardware threads). If not 1, f must be safe to
+ *                           call concurrently.
+ */
+template <typename Function>
+void finite_jacobian_extrapolated(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    Eigen::MatrixXd& error,
+    const StepSize& initial_step = StepSize::relative(0.1),
+    const int max_steps = 10,
+    const double tolerance = 0,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the hessian of a function using finite differences, storing
+ *        its upper triangle in packed format.
+ *
+ * The entry (i, j), i <= j, is stored at hess[i + j (j + 1) / 2], which is the
+ * LAPACK packed storage with UPLO = 'U' (e.g., for dpptrf), using half the
+ * memory of a dense matrix.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the hessian.
+ * @param[in]  f            Compute the hessian of this function.
+ * @param[out] hess         Computed hessian, packed into n (n + 1) / 2 values.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to share the entries of the upper
+ *                          triangle (0 uses all hardware threads). If not 1, f
+ *                          must be safe to call concurrently.
+ * @param[in]  stencil      Stencil used for the entries.
+ */
+template <typename Function>
+void finite_hessian_packed(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the diagonal of the hessian of a function using finite
+ *        differences.
+ *
+ * Uses the central second derivative stencil along each coordinate: k
+ * evaluations per coordinate, where k is the number of points in the first
+ * derivative stencil, plus one evaluation of f(x) shared by all coordinates.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the hessian.
+ * @param[in]  f            Compute the hessian of this function.
+ * @param[out] diag         Computed diagonal of the hessian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to split the coordinates across
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ */
+template <typename Function>
+void finite_hessian_diagonal(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& diag,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    unsigned num_threads = 1);
+
+/**
+ * @brief Compute the band |i - j| <= bandwidth of the hessian of a function
+ *        using finite differences.
+ *
+ * The entries outside the band are not computed and are set to zero.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x            Point at which to compute the hessian.
+ * @param[in]  f            Compute the hessian of this function.
+ * @param[in]  bandwidth    Number of diagonals above (and below) the main
+ *                          diagonal to compute.
+ * @param[out] hess         Computed hessian.
+ * @param[in]  accuracy     Accuracy of the finite differences.
+ * @param[in]  eps          Value of the finite difference step.
+ * @param[in]  num_threads  Number of threads to share the entries of the band
+ *                          (0 uses all hardware threads). If not 1, f must be
+ *                          safe to call concurrently.
+ * @param[in]  stencil      Stencil used for the entries.
+ */
+template <typename Function>
+void finite_hessian_banded(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Index bandwidth,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the hessian of a function from its gradient using finite
+ *        differences.
+ *
+ * Takes the finite difference jacobian of the gradient and symmetrizes it.
+ * This uses n * k evaluations of the gradient, where k is the number of
+ * points in the stencil, instead of O(n² k²) evaluations of the function.
+ *
+ * @tparam Gradient  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  grad      Gradient of the function whose hessian to compute.
+ * @param[out] hess      Computed hessian.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Gradient>
+void finite_hessian_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute the derivative of a function along a direction using finite
+ *        differences.
+ *
+ * Uses k evaluations of f, where k is the number of points in the stencil,
+ * regardless of the size of x.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the derivative.
+ * @param[in]  f         Function to differentiate.
+ * @param[in]  v         Direction along which to differentiate.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ * @return The directional derivative ∇f(x)ᵀv.
+ */
+template <typename Function>
+double finite_directional_derivative(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute the product of the jacobian of a function with a vector
+ *        using finite differences.
+ *
+ * Differentiates f along v, using k evaluations of f, where k is the number
+ * of points in the stencil, regardless of the size of x.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the jacobian.
+ * @param[in]  f         Function whose jacobian to multiply by v.
+ * @param[in]  v         Vector to multiply by the jacobian.
+ * @param[out] jv        Computed product of the jacobian and v.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Function>
+void finite_jacobian_vector_product(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    Eigen::VectorXd& jv,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute the product of the hessian of a function with a vector
+ *        using finite differences of the function.
+ *
+ * Each entry (Hv)ᵢ is a mixed second difference along eᵢ and v, so this uses
+ * n * k² evaluations of f and O(n) memory, where k is the number of points in
+ * the stencil. Prefer finite_hessian_vector_product_from_gradient() if the
+ * gradient is available.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  f         Function whose hessian to multiply by v.
+ * @param[in]  v         Vector to multiply by the hessian.
+ * @param[out] hv        Computed product of the hessian and v.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Function>
+void finite_hessian_vector_product(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    Eigen::VectorXd& hv,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5);
+
+/**
+ * @brief Compute the product of the hessian of a function with each column
+ *        of a matrix using finite differences of the function.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  f         Function whose hessian to multiply by V.
+ * @param[in]  V         Vectors to multiply by the hessian.
+ * @param[out] HV        Computed product of the hessian and V.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Function>
+void finite_hessian_vector_product(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::MatrixXd>& V,
+    Eigen::MatrixXd& HV,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5);
+
+/**
+ * @brief Compute the product of the hessian of a function with a vector
+ *        using finite differences of its gradient.
+ *
+ * Differentiates the gradient along v, using k evaluations of the gradient
+ * and O(n) memory, where k is the number of points in the stencil.
+ *
+ * @tparam Gradient  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  grad      Gradient of the function whose hessian to multiply.
+ * @param[in]  v         Vector to multiply by the hessian.
+ * @param[out] hv        Computed product of the hessian and v.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Gradient>
+void finite_hessian_vector_product_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    Eigen::VectorXd& hv,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute the product of the hessian of a function with each column
+ *        of a matrix using finite differences of its gradient.
+ *
+ * @tparam Gradient  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  grad      Gradient of the function whose hessian to multiply.
+ * @param[in]  V         Vectors to multiply by the hessian.
+ * @param[out] HV        Computed product of the hessian and V.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Gradient>
+void finite_hessian_vector_product_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::Ref<const Eigen::MatrixXd>& V,
+    Eigen::MatrixXd& HV,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute the gradient of a function of a fixed-size vector using
+ *        finite differences.
+ *
+ * All temporaries live on the stack and the stencil loops have compile-time
+ * bounds, so no heap allocation is performed.
+ *
+ * @tparam N         Number of variables.
+ * @tparam Function  Callable as double(const Eigen::Matrix<double, N, 1>&).
  * @param[in]  x         Point at which to compute the gradient.
  * @param[in]  f         Compute the gradient of this function.
  * @param[out] grad      Computed gradient.
  * @param[in]  accuracy  Accuracy of the finite differences.
  * @param[in]  eps       Value of the finite difference step.
  */
-void finite_gradient(
-    const Eigen::Ref<const Eigen::VectorXd>& x,
-    const std::function<double(const Eigen::VectorXd&)>& f,
-    Eigen::VectorXd& grad,
+template <int N, typename Function>
+typename std::enable_if<N != Eigen::Dynamic>::type finite_gradient(
+    const Eigen::Matrix<double, N, 1>& x,
+    const Function& f,
+    Eigen::Matrix<double, N, 1>& grad,
     const AccuracyOrder accuracy = SECOND,
     const double eps = 1.0e-8);
 
 /**
- * @brief Compute the jacobian of a function using finite differences.
+ * @brief Compute the jacobian of a function of a fixed-size vector using
+ *        finite differences.
+ *
+ * If M is fixed, no heap allocation is performed.
  *
+ * @tparam M         Number of outputs (may be Eigen::Dynamic).
+ * @tparam N         Number of variables.
+ * @tparam Function  Callable as Eigen::Matrix<double, M, 1>(
+ *                   const Eigen::Matrix<double, N, 1>&).
  * @param[in]  x         Point at which to compute the jacobian.
  * @param[in]  f         Compute the jacobian of this function.
  * @param[out] jac       Computed jacobian.
  * @param[in]  accuracy  Accuracy of the finite differences.
  * @param[in]  eps       Value of the finite difference step.
  */
-void finite_jacobian(
-    const Eigen::Ref<const Eigen::VectorXd>& x,
-    const std::function<Eigen::VectorXd(const Eigen::VectorXd&)>& f,
-    Eigen::MatrixXd& jac,
+template <int M, int N, typename Function>
+typename std::enable_if<N != Eigen::Dynamic>::type finite_jacobian(
+    const Eigen::Matrix<double, N, 1>& x,
+    const Function& f,
+    Eigen::Matrix<double, M, N>& jac,
     const AccuracyOrder accuracy = SECOND,
     const double eps = 1.0e-8);
 
 /**
- * @brief Compute the hessian of a function using finite differences.
+ * @brief Compute the hessian of a function of a fixed-size vector using
+ *        finite differences.
  *
+ * All temporaries live on the stack and the stencil loops have compile-time
+ * bounds, so no heap allocation is performed.
+ *
+ * @tparam N         Number of variables.
+ * @tparam Function  Callable as double(const Eigen::Matrix<double, N, 1>&).
  * @param[in]  x         Point at which to compute the hessian.
  * @param[in]  f         Compute the hessian of this function.
  * @param[out] hess      Computed hessian.
  * @param[in]  accuracy  Accuracy of the finite differences.
  * @param[in]  eps       Value of the finite difference step.
+ * @param[in]  stencil   Stencil used for the entries.
  */
-void finite_hessian(
+template <int N, typename Function>
+typename std::enable_if<N != Eigen::Dynamic>::type finite_hessian(
+    const Eigen::Matrix<double, N, 1>& x,
+    const Function& f,
+    Eigen::Matrix<double, N, N>& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    const HessianStencil stencil = FULL_STENCIL);
+
+/**
+ * @brief Compute the gradient of a function using finite differences,
+ *        evaluating the perturbed points in batches.
+ *
+ * @param[in]  x               Point at which to compute the gradient.
+ * @param[in]  f               Compute the gradient of this function. It is
+ *                             given a matrix whose columns are points and
+ *                             returns the vector of values at those points.
+ * @param[out] grad            Computed gradient.
+ * @param[in]  accuracy        Accuracy of the finite differences.
+ * @param[in]  eps             Value of the finite difference step.
+ * @param[in]  max_batch_size  Maximum number of points per call to f
+ *                             (0 evaluates all points in a single call).
+ */
+void finite_gradient_batched(
     const Eigen::Ref<const Eigen::VectorXd>& x,
-    const std::function<double(const Eigen::VectorXd&)>& f,
+    const std::function<Eigen::VectorXd(const Eigen::MatrixXd&)>& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const size_t max_batch_size = 0);
+
+/**
+ * @brief Compute the jacobian of a function using finite differences,
+ *        evaluating the perturbed points in batches.
+ *
+ * @param[in]  x               Point at which to compute the jacobian.
+ * @param[in]  f               Compute the jacobian of this function. It is
+ *                             given a matrix whose columns are points and
+ *                             returns a matrix whose columns are the values
+ *                             at those points.
+ * @param[out] jac             Computed jacobian.
+ * @param[in]  accuracy        Accuracy of the finite differences.
+ * @param[in]  eps             Value of the finite difference step.
+ * @param[in]  max_batch_size  Maximum number of points per call to f
+ *                             (0 evaluates all points in a single call).
+ */
+void finite_jacobian_batched(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<Eigen::MatrixXd(const Eigen::MatrixXd&)>& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const size_t max_batch_size = 0);
+
+/**
+ * @brief Compute the hessian of a function using finite differences,
+ *        evaluating the perturbed points in batches.
+ *
+ * @note The hessian requires O(n² k²) points for n variables and k stencil
+ * points, so a non-zero max_batch_size is recommended for large n.
+ *
+ * @param[in]  x               Point at which to compute the hessian.
+ * @param[in]  f               Compute the hessian of this function. It is
+ *                             given a matrix whose columns are points and
+ *                             returns the vector of values at those points.
+ * @param[out] hess            Computed hessian.
+ * @param[in]  accuracy        Accuracy of the finite differences.
+ * @param[in]  eps             Value of the finite difference step.
+ * @param[in]  max_batch_size  Maximum number of points per call to f
+ *                             (0 evaluates all points in a single call).
+ */
+void finite_hessian_batched(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const std::function<Eigen::VectorXd(const Eigen::MatrixXd&)>& f,
     Eigen::MatrixXd& hess,
     const AccuracyOrder accuracy = SECOND,
-    const double eps = 1.0e-5);
+    const double eps = 1.0e-5,
+    const size_t max_batch_size = 0);
 
 /**
  * @brief Compare if two gradients are close enough.
@@ -125,3 +1116,5 @@ Eigen::VectorXd flatten(const Eigen::Ref<const Eigen::MatrixXd>& X);
 Eigen::MatrixXd unflatten(const Eigen::Ref<const Eigen::VectorXd>& x, int dim);
 
 } // namespace fd
+
+#include "finitediff.tpp"
@@ -0,0 +1,1478 @@
+// Templated finite difference drivers. The objective is a template parameter,
+// so cheap functions can be inlined into the stencil loops.
+#pragma once
+
+#include "finitediff.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace fd {
+
+namespace internal {
+
+    // Resolve the number of worker threads to use for a range of the given
+    // size. A value of zero means use all available hardware threads.
+    inline unsigned resolve_num_threads(unsigned num_threads, const size_t size)
+    {
+        if (num_threads == 0) {
+            num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        return unsigned(
+            std::max<size_t>(std::min<size_t>(num_threads, size), 1));
+    }
+
+    // Split the range [0, size) into contiguous blocks, one per thread, and
+    // call fn(begin, end, thread) on each block. The caller must resolve the
+    // number of threads first. Any exception thrown by fn is rethrown on the
+    // calling thread once all workers have joined.
+    template <typename Function>
+    void parallel_for(
+        const size_t size, const unsigned num_threads, const Function& fn)
+    {
+        if (num_threads <= 1) {
+            fn(size_t(0), size, 0u);
+            return;
+        }
+
+        std::exception_ptr exception;
+        std::mutex exception_mutex;
+
+        std::vector<std::thread> workers;
+        workers.reserve(num_threads);
+        for (unsigned t = 0; t < num_threads; t++) {
+            const size_t begin = size * t / num_threads;
+            const size_t end = size * (t + 1) / num_threads;
+            workers.emplace_back([&, begin, end, t]() {
+                try {
+                    fn(begin, end, t);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    if (!exception) {
+                        exception = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    // Split the range [0, size) into chunks of chunk_size that the threads
+    // claim one at a time from a shared counter, calling fn(begin, end,
+    // thread) on each. Unlike parallel_for, this balances ranges whose
+    // elements differ in cost. The caller must resolve the number of threads
+    // first. Any exception thrown by fn is rethrown on the calling thread
+    // once all workers have joined.
+    template <typename Function>
+    void parallel_for_dynamic(
+        const size_t size,
+        const unsigned num_threads,
+        const size_t chunk_size,
+        const Function& fn)
+    {
+        assert(chunk_size > 0);
+        if (num_threads <= 1) {
+            fn(size_t(0), size, 0u);
+            return;
+        }
+
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::exception_ptr exception;
+        std::mutex exception_mutex;
+
+        const auto work = [&](unsigned t) {
+            try {
+                while (!failed) {
+                    const size_t begin = next.fetch_add(chunk_size);
+                    if (begin >= size) {
+                        break;
+                    }
+                    fn(begin, std::min(begin + chunk_size, size), t);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+                failed = true;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(num_threads);
+        for (unsigned t = 0; t < num_threads; t++) {
+            workers.emplace_back(work, t);
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    // Compile-time stencil coefficients for each accuracy order. These are
+    // the only copy of the coefficients; get_stencil() points into them. The
+    // unused Dummy parameter makes the out-of-class definitions of the static
+    // arrays templates, so they can live in this header.
+    // See: https://en.wikipedia.org/wiki/Finite_difference_coefficient
+    template <AccuracyOrder accuracy, typename Dummy = void> struct Stencil;
+
+    template <typename Dummy> struct Stencil<SECOND, Dummy> {
+        static constexpr size_t size = 2;
+        static constexpr double external_coeffs[size] = { 1, -1 };
+        static constexpr double internal_coeffs[size] = { 1, -1 };
+        static constexpr double denominator = 2;
+    };
+
+    template <typename Dummy> struct Stencil<FOURTH, Dummy> {
+        static constexpr size_t size = 4;
+        static constexpr double external_coeffs[size] = { 1, -8, 8, -1 };
+        static constexpr double internal_coeffs[size] = { -2, -1, 1, 2 };
+        static constexpr double denominator = 12;
+    };
+
+    template <typename Dummy> struct Stencil<SIXTH, Dummy> {
+        static constexpr size_t size = 6;
+        static constexpr double external_coeffs[size] = { -1, 9,  -45,
+                                                          45, -9, 1 };
+        static constexpr double internal_coeffs[size] = { -3, -2, -1,
+                                                          1,  2,  3 };
+        static constexpr double denominator = 60;
+    };
+
+    template <typename Dummy> struct Stencil<EIGHTH, Dummy> {
+        static constexpr size_t size = 8;
+        static constexpr double external_coeffs[size] = {
+            3, -32, 168, -672, 672, -168, 32, -3
+        };
+        static constexpr double internal_coeffs[size] = { -4, -3, -2, -1,
+                                                          1,  2,  3,  4 };
+        static constexpr double denominator = 840;
+    };
+
+    template <typename Dummy>
+    constexpr double Stencil<SECOND, Dummy>::external_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<SECOND, Dummy>::internal_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<FOURTH, Dummy>::external_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<FOURTH, Dummy>::internal_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<SIXTH, Dummy>::external_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<SIXTH, Dummy>::internal_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<EIGHTH, Dummy>::external_coeffs[];
+    template <typename Dummy>
+    constexpr double Stencil<EIGHTH, Dummy>::internal_coeffs[];
+
+    // Step of coordinate i, given either one step for every coordinate or a
+    // vector of steps.
+    inline double coordinate_step(const double eps, const Eigen::Index)
+    {
+        return eps;
+    }
+
+    inline double
+    coordinate_step(const Eigen::VectorXd& steps, const Eigen::Index i)
+    {
+        return steps[i];
+    }
+
+    // Gradient with the stencil known at compile time. For fixed-size
+    // vectors all loop bounds are constants, so the compiler can fully unroll
+    // them.
+    //
+    // x_buffers holds one perturbation vector of the size of x per thread.
+    // Steps is a double for the same step for every coordinate or a vector of
+    // steps.
+    template <
+        AccuracyOrder accuracy,
+        typename DerivedX,
+        typename Function,
+        typename DerivedGrad,
+        typename Steps,
+        typename Vector>
+    void gradient_with_stencil(
+        const Eigen::MatrixBase<DerivedX>& x,
+        const Function& f,
+        Eigen::PlainObjectBase<DerivedGrad>& grad,
+        const Steps& eps,
+        const unsigned num_threads,
+        Vector* x_buffers)
+    {
+        typedef Stencil<accuracy> S;
+
+        grad.setZero(x.rows());
+
+        // Each worker perturbs its own copy of x, so the coordinates are
+        // independent and the result does not depend on the number of
+        // threads.
+        const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+            Vector& x_mutable = x_buffers[thread];
+            x_mutable = x;
+            for (size_t i = begin; i < end; i++) {
+                const double h = coordinate_step(eps, i);
+                for (size_t ci = 0; ci < S::size; ci++) {
+                    x_mutable[i] += S::internal_coeffs[ci] * h;
+                    grad[i] += S::external_coeffs[ci] * f(x_mutable);
+                    x_mutable[i] = x[i];
+                }
+                grad[i] /= S::denominator * h;
+            }
+        };
+        parallel_for(x.rows(), num_threads, compute);
+    }
+
+    // Jacobian with the stencil known at compile time. Columns are split
+    // across threads, each with its own perturbation vector in x_buffers, and
+    // every column is computed exactly as in the serial loop, so the result
+    // does not depend on the number of threads.
+    template <
+        AccuracyOrder accuracy,
+        typename DerivedX,
+        typename Function,
+        typename DerivedJac,
+        typename Steps,
+        typename Vector>
+    void jacobian_with_stencil(
+        const Eigen::MatrixBase<DerivedX>& x,
+        const Function& f,
+        Eigen::PlainObjectBase<DerivedJac>& jac,
+        const Steps& eps,
+        const unsigned num_threads,
+        Vector* x_buffers)
+    {
+        typedef Stencil<accuracy> S;
+
+        typedef Eigen::Matrix<double, DerivedJac::RowsAtCompileTime, 1>
+            Column;
+        const bool dynamic_rows =
+            DerivedJac::RowsAtCompileTime == Eigen::Dynamic;
+
+        const auto compute_column = [&](Eigen::Index i, Vector& x_mutable) {
+            const double h = coordinate_step(eps, i);
+            for (size_t ci = 0; ci < S::size; ci++) {
+                x_mutable[i] += S::internal_coeffs[ci] * h;
+                const Column fx = f(x_mutable);
+                // A dynamic number of rows is sized from the first stencil
+                // evaluation instead of a separate evaluation at x.
+                if (dynamic_rows && i == 0 && ci == 0) {
+                    jac.setZero(fx.rows(), x.rows());
+                }
+                jac.col(i) += S::external_coeffs[ci] * fx;
+                x_mutable[i] = x[i];
+            }
+            jac.col(i) /= S::denominator * h;
+        };
+
+        Eigen::Index first = 0;
+        if (!dynamic_rows) {
+            jac.setZero(jac.rows(), x.rows());
+        } else if (x.rows() == 0) {
+            // There are no stencil evaluations to learn the size from.
+            x_buffers[0] = x;
+            jac.resize(f(x_buffers[0]).rows(), 0);
+            return;
+        } else {
+            // The first column sizes jac, so finish it before any worker
+            // writes to the others.
+            x_buffers[0] = x;
+            compute_column(0, x_buffers[0]);
+            first = 1;
+        }
+
+        const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+            Vector& x_mutable = x_buffers[thread];
+            x_mutable = x;
+            for (size_t i = begin; i < end; i++) {
+                compute_column(first + Eigen::Index(i), x_mutable);
+            }
+        };
+        parallel_for(x.rows() - first, num_threads, compute);
+    }
+
+    // Jacobian of a function that writes its value into an output buffer.
+    // Each thread has its own perturbation and output vectors.
+    template <AccuracyOrder accuracy, typename Function>
+    void jacobian_in_place_with_stencil(
+        const Eigen::Ref<const Eigen::VectorXd>& x,
+        const Function& f,
+        const Eigen::Index output_size,
+        Eigen::MatrixXd& jac,
+        const double eps,
+        const unsigned num_threads,
+        Eigen::VectorXd* x_buffers,
+        Eigen::VectorXd* fx_buffers)
+    {
+        typedef Stencil<accuracy> S;
+        const double denom = S::denominator * eps;
+
+        jac.setZero(output_size, x.rows());
+
+        const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+            Eigen::VectorXd& x_mutable = x_buffers[thread];
+            Eigen::VectorXd& fx = fx_buffers[thread];
+            x_mutable = x;
+            for (size_t i = begin; i < end; i++) {
+                for (size_t ci = 0; ci < S::size; ci++) {
+                    x_mutable[i] += S::internal_coeffs[ci] * eps;
+                    f(static_cast<const Eigen::VectorXd&>(x_mutable),
+                      Eigen::Ref<Eigen::VectorXd>(fx));
+                    jac.col(i) += S::external_coeffs[ci] * fx;
+                    x_mutable[i] = x[i];
+                }
+                jac.col(i) /= denom;
+            }
+        };
+        parallel_for(x.rows(), num_threads, compute);
+    }
+
+    // Richardson extrapolation weights αₖ / denominator of the steps k eps,
+    // k = 1..m, for the central differences with m steps on each side. For
+    // any central difference D(h) whose error is a series in h², Σₖ αₖ D(k h)
+    // cancels the terms up to h^(2m - 2), so the result has the same order of
+    // accuracy as the first derivative stencil with m steps on each side.
+    template <AccuracyOrder accuracy, typename Dummy = void>
+    struct ReducedStencil;
+
+    template <typename Dummy> struct ReducedStencil<SECOND, Dummy> {
+        static constexpr size_t size = 1;
+        static constexpr double weights[size] = { 1 };
+        static constexpr double denominator = 1;
+    };
+
+    template <typename Dummy> struct ReducedStencil<FOURTH, Dummy> {
+        static constexpr size_t size = 2;
+        static constexpr double weights[size] = { 4, -1 };
+        static constexpr double denominator = 3;
+    };
+
+    template <typename Dummy> struct ReducedStencil<SIXTH, Dummy> {
+        static constexpr size_t size = 3;
+        static constexpr double weights[size] = { 15, -6, 1 };
+        static constexpr double denominator = 10;
+    };
+
+    template <typename Dummy> struct ReducedStencil<EIGHTH, Dummy> {
+        static constexpr size_t size = 4;
+        static constexpr double weights[size] = { 56, -28, 8, -1 };
+        static constexpr double denominator = 35;
+    };
+
+    template <typename Dummy>
+    constexpr double ReducedStencil<SECOND, Dummy>::weights[];
+    template <typename Dummy>
+    constexpr double ReducedStencil<FOURTH, Dummy>::weights[];
+    template <typename Dummy>
+    constexpr double ReducedStencil<SIXTH, Dummy>::weights[];
+    template <typename Dummy>
+    constexpr double ReducedStencil<EIGHTH, Dummy>::weights[];
+
+    // Weights of the central second derivative stencil with m steps on each
+    // side, (f(x + k eps) - 2 f(x) + f(x - k eps)) / (k eps)² extrapolated
+    // with the reduced stencil weights. weights must hold 2m + 1 values and
+    // index o holds the weight of the offset o - m. The denominator is eps².
+    template <AccuracyOrder accuracy>
+    void second_derivative_weights(double* weights)
+    {
+        typedef ReducedStencil<accuracy> R;
+        std::fill(weights, weights + 2 * R::size + 1, 0.0);
+        for (size_t k = 1; k <= R::size; k++) {
+            const double w =
+                R::weights[k - 1] / (R::denominator * double(k * k));
+            weights[R::size + k] += w;
+            weights[R::size - k] += w;
+            weights[R::size] -= 2 * w;
+        }
+    }
+
+    // Weights of a stencil applied twice along the same coordinate, which
+    // only reaches the offsets cᵢ + cⱼ: the products of the external
+    // coefficients of all pairs (ci, cj) that land on the same offset are
+    // summed. The internal coefficients are the integers -m..m without 0, so
+    // the offsets are the integers -2m..2m and weights must hold 2 size + 1
+    // values. Index o holds the weight of the offset o - size.
+    inline void diagonal_stencil_weights(
+        const size_t size,
+        const double* external_coeffs,
+        const double* internal_coeffs,
+        double* weights)
+    {
+        std::fill(weights, weights + 2 * size + 1, 0.0);
+        for (size_t ci = 0; ci < size; ci++) {
+            for (size_t cj = 0; cj < size; cj++) {
+                const int offset =
+                    int(internal_coeffs[ci] + internal_coeffs[cj]);
+                weights[size_t(offset + int(size))] +=
+                    external_coeffs[ci] * external_coeffs[cj];
+            }
+        }
+    }
+
+    // Hessian with the stencil known at compile time. Only the entries with
+    // |i - j| <= bandwidth are computed; the others are left zero. The entries
+    // of the upper triangle, numbered row by row, are handed out to the
+    // threads in small chunks, since rows get shorter as i grows. Every entry
+    // is computed the same way regardless of the thread, so the result does
+    // not depend on the number of threads.
+    //
+    // Off-diagonal points x + cᵢ eps eᵢ + cⱼ eps eⱼ are all distinct, but on
+    // the diagonal the pairs (ci, cj) only reach the offsets cᵢ + cⱼ, so each
+    // offset is evaluated once with the summed weight. The zero offset is x
+    // itself for every i, so f(x) is evaluated once for the whole diagonal.
+    //
+    // The reduced stencil instead uses the second derivative stencil on the
+    // diagonal and the extrapolated four point cross stencil off it.
+    //
+    // Each computed entry (i, j), i <= j, is passed to store(i, j, value),
+    // which decides the storage of the hessian. Only the rows in
+    // [row_begin, row_end) are computed, so a hessian can be built in blocks
+    // of rows.
+    template <
+        AccuracyOrder accuracy,
+        typename DerivedX,
+        typename Function,
+        typename Store,
+        typename Steps,
+        typename Vector>
+    void hessian_with_stencil(
+        const Eigen::MatrixBase<DerivedX>& x,
+        const Function& f,
+        const Store& store,
+        const Steps& eps,
+        const unsigned num_threads,
+        Vector* x_buffers,
+        const HessianStencil stencil,
+        const Eigen::Index bandwidth,
+        const Eigen::Index row_begin = 0,
+        Eigen::Index row_end = std::numeric_limits<Eigen::Index>::max())
+    {
+        typedef Stencil<accuracy> S;
+        typedef ReducedStencil<accuracy> R;
+        const bool reduced = stencil == REDUCED_STENCIL;
+
+        // The entry (i, j) is divided by (scale hᵢ) (scale hⱼ).
+        const double scale = reduced ? 1 : S::denominator;
+
+        const Eigen::Index n = x.rows();
+        row_end = std::min(row_end, n);
+
+        const size_t num_offsets = 2 * S::size + 1;
+        double diagonal_weights[num_offsets];
+        const size_t center = S::size;
+        if (reduced) {
+            // The offsets of the second derivative stencil, -m..m, are the
+            // middle of the range -2m..2m.
+            std::fill(diagonal_weights, diagonal_weights + num_offsets, 0.0);
+            second_derivative_weights<accuracy>(
+                diagonal_weights + center - R::size);
+        } else {
+            diagonal_stencil_weights(
+                S::size, S::external_coeffs, S::internal_coeffs,
+                diagonal_weights);
+        }
+
+        double f_center = 0;
+        if (row_begin < row_end && diagonal_weights[center] != 0) {
+            x_buffers[0] = x;
+            f_center = f(x_buffers[0]);
+        }
+
+        // Number of entries of row i in the upper triangle of the band.
+        const Eigen::Index b =
+            std::max<Eigen::Index>(std::min(bandwidth, n - 1), 0);
+        const auto row_length = [&](Eigen::Index i) {
+            return std::min<Eigen::Index>(n - i, b + 1);
+        };
+
+        const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+            if (begin == end) {
+                return;
+            }
+            Vector& x_mutable = x_buffers[thread];
+            x_mutable = x;
+
+            // Find the row and column of the first entry in the chunk.
+            Eigen::Index i = row_begin;
+            size_t row_start = 0;
+            while (row_start + size_t(row_length(i)) <= begin) {
+                row_start += size_t(row_length(i));
+                i++;
+            }
+            Eigen::Index j = i + Eigen::Index(begin - row_start);
+
+            for (size_t entry = begin; entry < end; entry++) {
+                const double hi = coordinate_step(eps, i);
+                const double hj = coordinate_step(eps, j);
+                double value = 0;
+                if (i == j) {
+                    value = diagonal_weights[center] * f_center;
+                    for (size_t o = 0; o < num_offsets; o++) {
+                        if (o == center || diagonal_weights[o] == 0) {
+                            continue;
+                        }
+                        x_mutable[i] += (double(o) - double(center)) * hi;
+                        value += diagonal_weights[o] * f(x_mutable);
+                        x_mutable[i] = x[i];
+                    }
+                } else if (reduced) {
+                    // (f(+k, +k) - f(+k, -k) - f(-k, +k) + f(-k, -k)) / 4k²
+                    for (size_t k = 1; k <= R::size; k++) {
+                        const double w = R::weights[k - 1]
+                            / (R::denominator * 4 * double(k * k));
+                        for (int si = -1; si <= 1; si += 2) {
+                            for (int sj = -1; sj <= 1; sj += 2) {
+                                x_mutable[i] += si * (double(k) * hi);
+                                x_mutable[j] += sj * (double(k) * hj);
+                                value += si * sj * w * f(x_mutable);
+                                x_mutable[j] = x[j];
+                                x_mutable[i] = x[i];
+                            }
+                        }
+                    }
+                } else {
+                    for (size_t ci = 0; ci < S::size; ci++) {
+                        for (size_t cj = 0; cj < S::size; cj++) {
+                            x_mutable[i] += S::internal_coeffs[ci] * hi;
+                            x_mutable[j] += S::internal_coeffs[cj] * hj;
+                            value += S::external_coeffs[ci]
+                                * S::external_coeffs[cj] * f(x_mutable);
+                            x_mutable[j] = x[j];
+                            x_mutable[i] = x[i];
+                        }
+                    }
+                }
+                store(i, j, value / ((scale * hi) * (scale * hj)));
+
+                if (++j == i + row_length(i)) {
+                    i++;
+                    j = i;
+                }
+            }
+        };
+
+        size_t num_entries = 0;
+        for (Eigen::Index i = row_begin; i < row_end; i++) {
+            num_entries += size_t(row_length(i));
+        }
+        // Several chunks per thread let fast threads pick up the slack.
+        const size_t chunk_size =
+            std::max<size_t>(num_entries / (8 * size_t(num_threads)), 1);
+        parallel_for_dynamic(num_entries, num_threads, chunk_size, compute);
+    }
+
+    // Stores the entries of the hessian in a dense matrix, mirroring the upper
+    // triangle into the lower one.
+    template <typename Matrix> struct DenseHessianStore {
+        Matrix& hess;
+
+        void operator()(
+            const Eigen::Index i,
+            const Eigen::Index j,
+            const double value) const
+        {
+            hess(i, j) = value;
+            hess(j, i) = value; // The hessian is symmetric
+        }
+    };
+
+    // Stores the upper triangle of the hessian in LAPACK packed format.
+    struct PackedHessianStore {
+        Eigen::VectorXd& hess;
+
+        void operator()(
+            const Eigen::Index i,
+            const Eigen::Index j,
+            const double value) const
+        {
+            hess[i + j * (j + 1) / 2] = value;
+        }
+    };
+
+    // Diagonal of the hessian using the central second derivative stencil.
+    // The coordinates are split across threads as in gradient_with_stencil.
+    template <
+        AccuracyOrder accuracy,
+        typename DerivedX,
+        typename Function,
+        typename DerivedDiag,
+        typename Vector>
+    void hessian_diagonal_with_stencil(
+        const Eigen::MatrixBase<DerivedX>& x,
+        const Function& f,
+        Eigen::PlainObjectBase<DerivedDiag>& diag,
+        const double eps,
+        const unsigned num_threads,
+        Vector* x_buffers)
+    {
+        typedef ReducedStencil<accuracy> R;
+        const size_t num_offsets = 2 * R::size + 1;
+        double weights[num_offsets];
+        second_derivative_weights<accuracy>(weights);
+        const size_t center = R::size;
+
+        diag.setZero(x.rows());
+        if (x.rows() == 0) {
+            return;
+        }
+
+        // f(x) is shared by every coordinate.
+        x_buffers[0] = x;
+        const double f_center = f(x_buffers[0]);
+
+        const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+            Vector& x_mutable = x_buffers[thread];
+            x_mutable = x;
+            for (size_t i = begin; i < end; i++) {
+                diag[i] = weights[center] * f_center;
+                for (size_t o = 0; o < num_offsets; o++) {
+                    if (o == center) {
+                        continue;
+                    }
+                    x_mutable[i] += (double(o) - double(center)) * eps;
+                    diag[i] += weights[o] * f(x_mutable);
+                    x_mutable[i] = x[i];
+                }
+                diag[i] /= eps * eps;
+            }
+        };
+        parallel_for(x.rows(), num_threads, compute);
+    }
+
+    // Ridders' extrapolation of the central differences of f along
+    // coordinate i, where f returns an array of values. The tableau keeps
+    // only its last two rows: row[j] extrapolates the central differences of
+    // the last j + 1 steps.
+    template <typename Function>
+    void extrapolate_coordinate(
+        const Eigen::Ref<const Eigen::VectorXd>& x,
+        const Function& f,
+        const Eigen::Index i,
+        const double initial_step,
+        const int max_steps,
+        const double tolerance,
+        Eigen::VectorXd& x_mutable,
+        Eigen::ArrayXd& derivative,
+        Eigen::ArrayXd& error)
+    {
+        const double ratio = 1.4, ratio2 = ratio * ratio;
+        const double safe = 2; // Round-off dominates beyond this growth
+
+        std::vector<Eigen::ArrayXd> row, previous_row;
+        double h = initial_step;
+        for (int step = 0; step < max_steps; step++, h /= ratio) {
+            row.resize(step + 1);
+            x_mutable[i] = x[i] + h;
+            const Eigen::ArrayXd f_plus = f(x_mutable);
+            x_mutable[i] = x[i] - h;
+            const Eigen::ArrayXd f_minus = f(x_mutable);
+            x_mutable[i] = x[i];
+            row[0] = (f_plus - f_minus) / (2 * h);
+
+            if (step == 0) {
+                // There is no error estimate without a second step.
+                derivative = row[0];
+                error.setConstant(
+                    row[0].size(), std::numeric_limits<double>::infinity());
+            }
+
+            double factor = ratio2;
+            for (int j = 1; j <= step; j++, factor *= ratio2) {
+                row[j] = (factor * row[j - 1] - previous_row[j - 1])
+                    / (factor - 1);
+                const Eigen::ArrayXd entry_error =
+                    (row[j] - row[j - 1])
+                        .abs()
+                        .max((row[j] - previous_row[j - 1]).abs());
+                const Eigen::Array<bool, Eigen::Dynamic, 1> better =
+                    entry_error <= error;
+                derivative = better.select(row[j], derivative);
+                error = better.select(entry_error, error);
+            }
+
+            if (step > 0
+                && ((row[step] - previous_row[step - 1]).abs() >= safe * error)
+                       .all()) {
+                break;
+            }
+            if ((error <= tolerance).all()) {
+                break;
+            }
+            std::swap(row, previous_row);
+        }
+    }
+
+} // namespace internal
+
+template <typename Function>
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads)
+{
+    Workspace workspace;
+    finite_gradient(x, f, grad, workspace, accuracy, eps, num_threads);
+}
+
+template <typename Function>
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    Workspace& workspace,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads)
+{
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::gradient_with_stencil<SECOND>(
+            x, f, grad, eps, num_threads, x_buffers);
+    case FOURTH:
+        return internal::gradient_with_stencil<FOURTH>(
+            x, f, grad, eps, num_threads, x_buffers);
+    case SIXTH:
+        return internal::gradient_with_stencil<SIXTH>(
+            x, f, grad, eps, num_threads, x_buffers);
+    case EIGHTH:
+        return internal::gradient_with_stencil<EIGHTH>(
+            x, f, grad, eps, num_threads, x_buffers);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads)
+{
+    Workspace workspace;
+    finite_jacobian(x, f, jac, workspace, accuracy, eps, num_threads);
+}
+
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    Workspace& workspace,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads)
+{
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::jacobian_with_stencil<SECOND>(
+            x, f, jac, eps, num_threads, x_buffers);
+    case FOURTH:
+        return internal::jacobian_with_stencil<FOURTH>(
+            x, f, jac, eps, num_threads, x_buffers);
+    case SIXTH:
+        return internal::jacobian_with_stencil<SIXTH>(
+            x, f, jac, eps, num_threads, x_buffers);
+    case EIGHTH:
+        return internal::jacobian_with_stencil<EIGHTH>(
+            x, f, jac, eps, num_threads, x_buffers);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Index output_size,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads)
+{
+    Workspace workspace;
+    finite_jacobian(
+        x, f, output_size, jac, workspace, accuracy, eps, num_threads);
+}
+
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Index output_size,
+    Eigen::MatrixXd& jac,
+    Workspace& workspace,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads)
+{
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+    Eigen::VectorXd* fx_buffers =
+        workspace.output_buffers(output_size, num_threads);
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::jacobian_in_place_with_stencil<SECOND>(
+            x, f, output_size, jac, eps, num_threads, x_buffers, fx_buffers);
+    case FOURTH:
+        return internal::jacobian_in_place_with_stencil<FOURTH>(
+            x, f, output_size, jac, eps, num_threads, x_buffers, fx_buffers);
+    case SIXTH:
+        return internal::jacobian_in_place_with_stencil<SIXTH>(
+            x, f, output_size, jac, eps, num_threads, x_buffers, fx_buffers);
+    case EIGHTH:
+        return internal::jacobian_in_place_with_stencil<EIGHTH>(
+            x, f, output_size, jac, eps, num_threads, x_buffers, fx_buffers);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    Eigen::VectorXd& fx,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads)
+{
+    const Eigen::VectorXd x_copy = x;
+    fx = f(x_copy);
+    if (x.size() == 0) {
+        jac.resize(fx.rows(), 0);
+        return;
+    }
+    finite_jacobian(x, f, jac, accuracy, eps, num_threads);
+}
+
+template <typename Function>
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads,
+    const HessianStencil stencil)
+{
+    Workspace workspace;
+    finite_hessian(x, f, hess, workspace, accuracy, eps, num_threads, stencil);
+}
+
+template <typename Function>
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    Workspace& workspace,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads,
+    const HessianStencil stencil)
+{
+    const size_t num_entries = size_t(x.size()) * size_t(x.size() + 1) / 2;
+    num_threads = internal::resolve_num_threads(num_threads, num_entries);
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    hess.setZero(x.size(), x.size());
+    const internal::DenseHessianStore<Eigen::MatrixXd> store = { hess };
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::hessian_with_stencil<SECOND>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    case FOURTH:
+        return internal::hessian_with_stencil<FOURTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    case SIXTH:
+        return internal::hessian_with_stencil<SIXTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    case EIGHTH:
+        return internal::hessian_with_stencil<EIGHTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    const AccuracyOrder accuracy,
+    const StepSize& step,
+    unsigned num_threads)
+{
+    const Eigen::VectorXd steps = step.steps(x, accuracy, 1);
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::gradient_with_stencil<SECOND>(
+            x, f, grad, steps, num_threads, x_buffers);
+    case FOURTH:
+        return internal::gradient_with_stencil<FOURTH>(
+            x, f, grad, steps, num_threads, x_buffers);
+    case SIXTH:
+        return internal::gradient_with_stencil<SIXTH>(
+            x, f, grad, steps, num_threads, x_buffers);
+    case EIGHTH:
+        return internal::gradient_with_stencil<EIGHTH>(
+            x, f, grad, steps, num_threads, x_buffers);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    const AccuracyOrder accuracy,
+    const StepSize& step,
+    unsigned num_threads)
+{
+    const Eigen::VectorXd steps = step.steps(x, accuracy, 1);
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::jacobian_with_stencil<SECOND>(
+            x, f, jac, steps, num_threads, x_buffers);
+    case FOURTH:
+        return internal::jacobian_with_stencil<FOURTH>(
+            x, f, jac, steps, num_threads, x_buffers);
+    case SIXTH:
+        return internal::jacobian_with_stencil<SIXTH>(
+            x, f, jac, steps, num_threads, x_buffers);
+    case EIGHTH:
+        return internal::jacobian_with_stencil<EIGHTH>(
+            x, f, jac, steps, num_threads, x_buffers);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy,
+    const StepSize& step,
+    unsigned num_threads,
+    const HessianStencil stencil)
+{
+    const Eigen::VectorXd steps = step.steps(x, accuracy, 2);
+    const size_t num_entries = size_t(x.size()) * size_t(x.size() + 1) / 2;
+    num_threads = internal::resolve_num_threads(num_threads, num_entries);
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    hess.setZero(x.size(), x.size());
+    const internal::DenseHessianStore<Eigen::MatrixXd> store = { hess };
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::hessian_with_stencil<SECOND>(
+            x, f, store, steps, num_threads, x_buffers, stencil, x.size());
+    case FOURTH:
+        return internal::hessian_with_stencil<FOURTH>(
+            x, f, store, steps, num_threads, x_buffers, stencil, x.size());
+    case SIXTH:
+        return internal::hessian_with_stencil<SIXTH>(
+            x, f, store, steps, num_threads, x_buffers, stencil, x.size());
+    case EIGHTH:
+        return internal::hessian_with_stencil<EIGHTH>(
+            x, f, store, steps, num_threads, x_buffers, stencil, x.size());
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_gradient_extrapolated(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& grad,
+    Eigen::VectorXd& error,
+    const StepSize& initial_step,
+    const int max_steps,
+    const double tolerance,
+    unsigned num_threads)
+{
+    assert(max_steps > 0);
+    const Eigen::VectorXd steps = initial_step.steps(x, SECOND, 1);
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    const auto f_array = [&](const Eigen::VectorXd& y) -> Eigen::ArrayXd {
+        return Eigen::ArrayXd::Constant(1, f(y));
+    };
+
+    grad.resize(x.size());
+    error.resize(x.size());
+    const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+        Eigen::VectorXd& x_mutable = x_buffers[thread];
+        x_mutable = x;
+        Eigen::ArrayXd derivative, entry_error;
+        for (size_t i = begin; i < end; i++) {
+            internal::extrapolate_coordinate(
+                x, f_array, i, steps[i], max_steps, tolerance, x_mutable,
+                derivative, entry_error);
+            grad[i] = derivative[0];
+            error[i] = entry_error[0];
+        }
+    };
+    internal::parallel_for(x.size(), num_threads, compute);
+}
+
+template <typename Function>
+void finite_jacobian_extrapolated(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    Eigen::MatrixXd& error,
+    const StepSize& initial_step,
+    const int max_steps,
+    const double tolerance,
+    unsigned num_threads)
+{
+    assert(max_steps > 0);
+    if (x.size() == 0) {
+        // There are no steps to learn the number of rows from.
+        const Eigen::VectorXd x_copy = x;
+        jac.resize(f(x_copy).rows(), 0);
+        error.resize(jac.rows(), 0);
+        return;
+    }
+
+    const Eigen::VectorXd steps = initial_step.steps(x, SECOND, 1);
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    const auto f_array = [&](const Eigen::VectorXd& y) -> Eigen::ArrayXd {
+        return f(y).array();
+    };
+
+    // The columns are gathered first, since the number of rows is only known
+    // from the evaluations of f.
+    std::vector<Eigen::ArrayXd> columns(x.size()), column_errors(x.size());
+    const auto compute = [&](size_t begin, size_t end, unsigned thread) {
+        Eigen::VectorXd& x_mutable = x_buffers[thread];
+        x_mutable = x;
+        for (size_t i = begin; i < end; i++) {
+            internal::extrapolate_coordinate(
+                x, f_array, i, steps[i], max_steps, tolerance, x_mutable,
+                columns[i], column_errors[i]);
+        }
+    };
+    internal::parallel_for(x.size(), num_threads, compute);
+
+    jac.resize(columns[0].size(), x.size());
+    error.resize(columns[0].size(), x.size());
+    for (Eigen::Index i = 0; i < x.size(); i++) {
+        jac.col(i) = columns[i].matrix();
+        error.col(i) = column_errors[i].matrix();
+    }
+}
+
+template <typename Function>
+void finite_hessian_packed(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& hess,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads,
+    const HessianStencil stencil)
+{
+    const size_t num_entries = size_t(x.size()) * size_t(x.size() + 1) / 2;
+    num_threads = internal::resolve_num_threads(num_threads, num_entries);
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    hess.setZero(num_entries);
+    const internal::PackedHessianStore store = { hess };
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::hessian_with_stencil<SECOND>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    case FOURTH:
+        return internal::hessian_with_stencil<FOURTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    case SIXTH:
+        return internal::hessian_with_stencil<SIXTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    case EIGHTH:
+        return internal::hessian_with_stencil<EIGHTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, x.size());
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_hessian_diagonal(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::VectorXd& diag,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads)
+{
+    num_threads = internal::resolve_num_threads(num_threads, x.size());
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::hessian_diagonal_with_stencil<SECOND>(
+            x, f, diag, eps, num_threads, x_buffers);
+    case FOURTH:
+        return internal::hessian_diagonal_with_stencil<FOURTH>(
+            x, f, diag, eps, num_threads, x_buffers);
+    case SIXTH:
+        return internal::hessian_diagonal_with_stencil<SIXTH>(
+            x, f, diag, eps, num_threads, x_buffers);
+    case EIGHTH:
+        return internal::hessian_diagonal_with_stencil<EIGHTH>(
+            x, f, diag, eps, num_threads, x_buffers);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Function>
+void finite_hessian_banded(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Index bandwidth,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads,
+    const HessianStencil stencil)
+{
+    assert(bandwidth >= 0);
+    num_threads = internal::resolve_num_threads(
+        num_threads,
+        size_t(x.size()) * size_t(std::min(bandwidth, x.size()) + 1));
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers =
+        workspace.perturbation_buffers(x.size(), num_threads);
+
+    hess.setZero(x.size(), x.size());
+    const internal::DenseHessianStore<Eigen::MatrixXd> store = { hess };
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::hessian_with_stencil<SECOND>(
+            x, f, store, eps, num_threads, x_buffers, stencil, bandwidth);
+    case FOURTH:
+        return internal::hessian_with_stencil<FOURTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, bandwidth);
+    case SIXTH:
+        return internal::hessian_with_stencil<SIXTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, bandwidth);
+    case EIGHTH:
+        return internal::hessian_with_stencil<EIGHTH>(
+            x, f, store, eps, num_threads, x_buffers, stencil, bandwidth);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <typename Gradient>
+void finite_hessian_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    Eigen::MatrixXd& hess,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    finite_jacobian(x, grad, hess, accuracy, eps);
+    assert(hess.rows() == hess.cols());
+
+    // The hessian is symmetric, so average the two finite difference
+    // approximations of each off-diagonal entry.
+    for (Eigen::Index i = 0; i < hess.rows(); i++) {
+        for (Eigen::Index j = i + 1; j < hess.cols(); j++) {
+            hess(i, j) = hess(j, i) = 0.5 * (hess(i, j) + hess(j, i));
+        }
+    }
+}
+
+template <typename Function>
+double finite_directional_derivative(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    assert(v.size() == x.size());
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+
+    double derivative = 0;
+    Eigen::VectorXd x_mutable(x.size());
+    for (size_t ci = 0; ci < stencil.size; ci++) {
+        x_mutable = x + (stencil.internal_coeffs[ci] * eps) * v;
+        derivative += stencil.external_coeffs[ci] * f(x_mutable);
+    }
+    return derivative / (stencil.denominator * eps);
+}
+
+template <typename Function>
+void finite_jacobian_vector_product(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    Eigen::VectorXd& jv,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    assert(v.size() == x.size());
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+
+    // The size of f(x) is unknown until the first evaluation.
+    Eigen::VectorXd x_mutable(x.size());
+    for (size_t ci = 0; ci < stencil.size; ci++) {
+        x_mutable = x + (stencil.internal_coeffs[ci] * eps) * v;
+        if (ci == 0) {
+            jv = stencil.external_coeffs[ci] * f(x_mutable);
+        } else {
+            jv += stencil.external_coeffs[ci] * f(x_mutable);
+        }
+    }
+    jv /= stencil.denominator * eps;
+}
+
+template <typename Function>
+void finite_hessian_vector_product(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    Eigen::VectorXd& hv,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    assert(v.size() == x.size());
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    double denom = stencil.denominator * eps;
+    denom *= denom;
+
+    hv.setZero(x.size());
+
+    // (Hv)ᵢ = ∂²f(x + s eᵢ + t v) / ∂s ∂t at s = t = 0
+    Eigen::VectorXd x_v(x.size()), x_mutable(x.size());
+    for (size_t cj = 0; cj < stencil.size; cj++) {
+        x_v = x + (stencil.internal_coeffs[cj] * eps) * v;
+        x_mutable = x_v;
+        for (Eigen::Index i = 0; i < x.size(); i++) {
+            for (size_t ci = 0; ci < stencil.size; ci++) {
+                x_mutable[i] += stencil.internal_coeffs[ci] * eps;
+                hv[i] += stencil.external_coeffs[ci]
+                    * stencil.external_coeffs[cj] * f(x_mutable);
+                x_mutable[i] = x_v[i];
+            }
+        }
+    }
+    hv /= denom;
+}
+
+template <typename Function>
+void finite_hessian_vector_product(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::MatrixXd>& V,
+    Eigen::MatrixXd& HV,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    HV.resize(V.rows(), V.cols());
+    Eigen::VectorXd hv;
+    for (Eigen::Index j = 0; j < V.cols(); j++) {
+        finite_hessian_vector_product(x, f, V.col(j), hv, accuracy, eps);
+        HV.col(j) = hv;
+    }
+}
+
+template <typename Gradient>
+void finite_hessian_vector_product_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::Ref<const Eigen::VectorXd>& v,
+    Eigen::VectorXd& hv,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    // Hv is the jacobian of the gradient times v.
+    finite_jacobian_vector_product(x, grad, v, hv, accuracy, eps);
+}
+
+template <typename Gradient>
+void finite_hessian_vector_product_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::Ref<const Eigen::MatrixXd>& V,
+    Eigen::MatrixXd& HV,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    HV.resize(V.rows(), V.cols());
+    Eigen::VectorXd hv;
+    for (Eigen::Index j = 0; j < V.cols(); j++) {
+        finite_hessian_vector_product_from_gradient(
+            x, grad, V.col(j), hv, accuracy, eps);
+        HV.col(j) = hv;
+    }
+}
+
+template <int N, typename Function>
+typename std::enable_if<N != Eigen::Dynamic>::type finite_gradient(
+    const Eigen::Matrix<double, N, 1>& x,
+    const Function& f,
+    Eigen::Matrix<double, N, 1>& grad,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    Eigen::Matrix<double, N, 1> x_mutable;
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::gradient_with_stencil<SECOND>(
+            x, f, grad, eps, 1, &x_mutable);
+    case FOURTH:
+        return internal::gradient_with_stencil<FOURTH>(
+            x, f, grad, eps, 1, &x_mutable);
+    case SIXTH:
+        return internal::gradient_with_stencil<SIXTH>(
+            x, f, grad, eps, 1, &x_mutable);
+    case EIGHTH:
+        return internal::gradient_with_stencil<EIGHTH>(
+            x, f, grad, eps, 1, &x_mutable);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <int M, int N, typename Function>
+typename std::enable_if<N != Eigen::Dynamic>::type finite_jacobian(
+    const Eigen::Matrix<double, N, 1>& x,
+    const Function& f,
+    Eigen::Matrix<double, M, N>& jac,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    Eigen::Matrix<double, N, 1> x_mutable;
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::jacobian_with_stencil<SECOND>(
+            x, f, jac, eps, 1, &x_mutable);
+    case FOURTH:
+        return internal::jacobian_with_stencil<FOURTH>(
+            x, f, jac, eps, 1, &x_mutable);
+    case SIXTH:
+        return internal::jacobian_with_stencil<SIXTH>(
+            x, f, jac, eps, 1, &x_mutable);
+    case EIGHTH:
+        return internal::jacobian_with_stencil<EIGHTH>(
+            x, f, jac, eps, 1, &x_mutable);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+template <int N, typename Function>
+typename std::enable_if<N != Eigen::Dynamic>::type finite_hessian(
+    const Eigen::Matrix<double, N, 1>& x,
+    const Function& f,
+    Eigen::Matrix<double, N, N>& hess,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const HessianStencil stencil)
+{
+    Eigen::Matrix<double, N, 1> x_mutable;
+
+    hess.setZero();
+    const internal::DenseHessianStore<Eigen::Matrix<double, N, N>> store = {
+        hess
+    };
+
+    switch (accuracy) {
+    case SECOND:
+        return internal::hessian_with_stencil<SECOND>(
+            x, f, store, eps, 1, &x_mutable, stencil, N);
+    case FOURTH:
+        return internal::hessian_with_stencil<FOURTH>(
+            x, f, store, eps, 1, &x_mutable, stencil, N);
+    case SIXTH:
+        return internal::hessian_with_stencil<SIXTH>(
+            x, f, store, eps, 1, &x_mutable, stencil, N);
+    case EIGHTH:
+        return internal::hessian_with_stencil<EIGHTH>(
+            x, f, store, eps, 1, &x_mutable, stencil, N);
+    default:
+        throw std::invalid_argument("invalid accuracy order");
+    }
+}
+
+} // namespace fd
@@ -0,0 +1,257 @@
+/**
+ * @brief Cache of function evaluations shared by finite difference calls.
+ *
+ * Wrapping a function in an evaluation cache lets repeated calls (e.g.,
+ * finite_gradient followed by finite_hessian at the same x and step) reuse
+ * the values at stencil points they have in common. An evaluation store also
+ * keeps the values on disk, so they survive the process.
+ */
+#pragma once
+
+#include "finitediff.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <Eigen/Core>
+
+namespace fd {
+
+template <typename Function, typename Cache> class CachedFunction;
+
+/**
+ * @brief Cache of the values of functions at points, keyed by the exact bits
+ *        of the point.
+ *
+ * When the estimated memory of the cache exceeds its cap, the least recently
+ * used entries are evicted. A cache can be shared by concurrent calls.
+ *
+ * @tparam Result  Type of the function values: double for finite_gradient
+ *                 and finite_hessian, or Eigen::VectorXd for finite_jacobian.
+ */
+template <typename Result = double> class EvaluationCache {
+public:
+    typedef Result result_type;
+
+    /**
+     * @brief Construct an empty cache.
+     *
+     * @param[in] max_bytes  Cap on the estimated memory of the cache in bytes
+     *                       (0 means unlimited).
+     */
+    explicit EvaluationCache(const size_t max_bytes = 0);
+
+    EvaluationCache(const EvaluationCache&) = delete;
+    EvaluationCache& operator=(const EvaluationCache&) = delete;
+
+    /**
+     * @brief Wrap a function so its evaluations go through this cache.
+     *
+     * The returned callable refers to both f and the cache, so both must
+     * outlive it. A cache should only be used with a single function.
+     *
+     * @param[in] f  Function to wrap.
+     *
+     * @return Callable as Result(const Eigen::VectorXd&).
+     */
+    template <typename Function>
+    CachedFunction<Function, EvaluationCache> wrap(const Function& f);
+
+    /**
+     * @brief Get the value of f at x from the cache, evaluating and storing it
+     *        on a miss.
+     *
+     * @param[in] f  Function to evaluate.
+     * @param[in] x  Point at which to evaluate f.
+     *
+     * @return The value of f at x.
+     */
+    template <typename Function>
+    Result evaluate(const Function& f, const Eigen::VectorXd& x);
+
+    /// @brief Remove all entries and reset the statistics.
+    void clear();
+
+    /// @brief Number of evaluations served from the cache.
+    size_t hits() const;
+
+    /// @brief Number of evaluations that called the function.
+    size_t misses() const;
+
+    /// @brief Number of entries evicted to respect the memory cap.
+    size_t evictions() const;
+
+    /// @brief Number of entries in the cache.
+    size_t size() const;
+
+    /// @brief Estimated memory of the entries in bytes.
+    size_t memory_usage() const;
+
+    /// @brief Cap on the estimated memory in bytes (0 means unlimited).
+    size_t max_bytes() const { return m_max_bytes; }
+
+protected:
+    struct Entry {
+        Eigen::VectorXd x;
+        Result value;
+        size_t bytes;
+    };
+
+    // The map is keyed by pointers to the points owned by the entries, so a
+    // lookup needs no copy of the query point.
+    struct KeyHash {
+        size_t operator()(const Eigen::VectorXd* x) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Eigen::VectorXd* a, const Eigen::VectorXd* b)
+            const;
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<
+        const Eigen::VectorXd*,
+        typename EntryList::iterator,
+        KeyHash,
+        KeyEqual>
+        EntryMap;
+
+    /// @brief Evict least recently used entries until within the cap.
+    void evict();
+
+    /// @brief Entries from most to least recently used.
+    EntryList m_entries;
+    /// @brief Index of the entries by point.
+    EntryMap m_index;
+
+    size_t m_max_bytes;
+    size_t m_bytes = 0;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+    size_t m_evictions = 0;
+
+    mutable std::mutex m_mutex;
+};
+
+/**
+ * @brief Persistent store of the values of a function at points, keyed by the
+ *        exact bits of the point.
+ *
+ * Every new evaluation is appended to a file and flushed before it is used,
+ * and the file is loaded when the store is opened. A run that is interrupted
+ * (e.g., a crash midway through finite_hessian) can therefore be repeated
+ * with the same store, and only the evaluations that were not completed are
+ * performed again. A truncated record at the end of the file, left by an
+ * interrupted write, is discarded. A store can be shared by concurrent calls
+ * but not by concurrent processes.
+ *
+ * @tparam Result  Type of the function values: double for finite_gradient
+ *                 and finite_hessian, or Eigen::VectorXd for finite_jacobian.
+ */
+template <typename Result = double> class EvaluationStore {
+public:
+    typedef Result result_type;
+
+    /**
+     * @brief Open the store at a path, creating the file if needed.
+     *
+     * @param[in] path  Path of the file of the store.
+     * @throws std::runtime_error if the file cannot be opened or does not
+     *         hold a store of this type.
+     */
+    explicit EvaluationStore(const std::string& path);
+
+    EvaluationStore(const EvaluationStore&) = delete;
+    EvaluationStore& operator=(const EvaluationStore&) = delete;
+
+    /**
+     * @brief Wrap a function so its evaluations go through this store.
+     *
+     * The returned callable refers to both f and the store, so both must
+     * outlive it. A store should only be used with a single function.
+     *
+     * @param[in] f  Function to wrap.
+     *
+     * @return Callable as Result(const Eigen::VectorXd&).
+     */
+    template <typename Function>
+    CachedFunction<Function, EvaluationStore> wrap(const Function& f);
+
+    /**
+     * @brief Get the value of f at x from the store, evaluating and appending
+     *        it on a miss.
+     *
+     * @param[in] f  Function to evaluate.
+     * @param[in] x  Point at which to evaluate f.
+     *
+     * @return The value of f at x.
+     */
+    template <typename Function>
+    Result evaluate(const Function& f, const Eigen::VectorXd& x);
+
+    /// @brief Number of evaluations served from the store.
+    size_t hits() const;
+
+    /// @brief Number of evaluations that called the function.
+    size_t misses() const;
+
+    /// @brief Number of entries in the store, including those loaded.
+    size_t size() const;
+
+    /// @brief Path of the file of the store.
+    const std::string& path() const { return m_path; }
+
+protected:
+    struct KeyHash {
+        size_t operator()(const Eigen::VectorXd& x) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Eigen::VectorXd& a, const Eigen::VectorXd& b)
+            const;
+    };
+
+    /// @brief Load the records of the file, dropping a truncated last one.
+    void load();
+
+    std::string m_path;
+    std::ofstream m_file;
+    std::unordered_map<Eigen::VectorXd, Result, KeyHash, KeyEqual> m_values;
+
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+
+    mutable std::mutex m_mutex;
+};
+
+/**
+ * @brief Callable that evaluates a function through an EvaluationCache or an
+ *        EvaluationStore.
+ *
+ * @tparam Function  Callable as Cache::result_type(const Eigen::VectorXd&).
+ * @tparam Cache     EvaluationCache or EvaluationStore.
+ */
+template <typename Function, typename Cache> class CachedFunction {
+public:
+    CachedFunction(const Function& f, Cache& cache)
+        : m_f(f)
+        , m_cache(cache)
+    {
+    }
+
+    typename Cache::result_type operator()(const Eigen::VectorXd& x) const
+    {
+        return m_cache.evaluate(m_f, x);
+    }
+
+protected:
+    const Function& m_f;
+    Cache& m_cache;
+};
+
+} // namespace fd
+
+#include "finitediff_cache.tpp"
@@ -0,0 +1,325 @@
+// Evaluation cache implementation.
+#pragma once
+
+#include "finitediff_cache.hpp"
+#include "finitediff_io.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace fd {
+
+namespace internal {
+
+    // Estimated memory of a cached value in bytes.
+    inline size_t value_bytes(const double) { return sizeof(double); }
+
+    inline size_t value_bytes(const Eigen::VectorXd& value)
+    {
+        return sizeof(Eigen::VectorXd) + value.size() * sizeof(double);
+    }
+
+    // Hash the bits of a point, so points are only equal if they are bitwise
+    // identical.
+    inline size_t hash_point(const Eigen::VectorXd& x)
+    {
+        size_t seed = std::hash<Eigen::Index>()(x.size());
+        for (Eigen::Index i = 0; i < x.size(); i++) {
+            uint64_t bits;
+            std::memcpy(&bits, x.data() + i, sizeof(bits));
+            seed ^= std::hash<uint64_t>()(bits) + 0x9e3779b97f4a7c15ULL
+                + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+
+    // Binary records of an evaluation store. Each record is the size of the
+    // point, the point, and the value (a vector value is also preceded by its
+    // size), all in native byte order.
+    inline const char* store_magic(const double) { return "fdstord1"; }
+
+    inline const char* store_magic(const Eigen::VectorXd&)
+    {
+        return "fdstorv1";
+    }
+
+    inline void write_value(std::ostream& out, const double value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    inline void write_value(std::ostream& out, const Eigen::VectorXd& value)
+    {
+        write_vector(out, value);
+    }
+
+    inline bool read_value(std::istream& in, double& value)
+    {
+        return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    inline bool read_value(std::istream& in, Eigen::VectorXd& value)
+    {
+        return read_vector(in, value);
+    }
+
+} // namespace internal
+
+template <typename Result>
+EvaluationCache<Result>::EvaluationCache(const size_t max_bytes)
+    : m_max_bytes(max_bytes)
+{
+}
+
+template <typename Result>
+template <typename Function>
+CachedFunction<Function, EvaluationCache<Result>>
+EvaluationCache<Result>::wrap(const Function& f)
+{
+    return CachedFunction<Function, EvaluationCache<Result>>(f, *this);
+}
+
+template <typename Result>
+template <typename Function>
+Result
+EvaluationCache<Result>::evaluate(const Function& f, const Eigen::VectorXd& x)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto found = m_index.find(&x);
+        if (found != m_index.end()) {
+            m_hits++;
+            // Move the entry to the front as the most recently used.
+            m_entries.splice(m_entries.begin(), m_entries, found->second);
+            return found->second->value;
+        }
+        m_misses++;
+    }
+
+    // Evaluate outside the lock so concurrent misses do not serialize.
+    Result value = f(x);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_index.find(&x) != m_index.end()) {
+        return value; // Another thread stored it in the meantime
+    }
+
+    Entry entry = { x, value, 0 };
+    // Point, value, list node, and hash map node.
+    entry.bytes = sizeof(Entry) + x.size() * sizeof(double)
+        + internal::value_bytes(value) + 4 * sizeof(void*);
+    m_bytes += entry.bytes;
+    m_entries.push_front(std::move(entry));
+    m_index.emplace(&m_entries.front().x, m_entries.begin());
+
+    evict();
+    return value;
+}
+
+template <typename Result> void EvaluationCache<Result>::evict()
+{
+    // Always keep the newest entry, even if it alone exceeds the cap.
+    while (m_max_bytes > 0 && m_bytes > m_max_bytes && m_entries.size() > 1) {
+        const Entry& oldest = m_entries.back();
+        m_index.erase(&oldest.x);
+        m_bytes -= oldest.bytes;
+        m_entries.pop_back();
+        m_evictions++;
+    }
+}
+
+template <typename Result> void EvaluationCache<Result>::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_entries.clear();
+    m_bytes = m_hits = m_misses = m_evictions = 0;
+}
+
+template <typename Result> size_t EvaluationCache<Result>::hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+template <typename Result> size_t EvaluationCache<Result>::misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+template <typename Result> size_t EvaluationCache<Result>::evictions() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_evictions;
+}
+
+template <typename Result> size_t EvaluationCache<Result>::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+template <typename Result> size_t EvaluationCache<Result>::memory_usage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+template <typename Result>
+size_t
+EvaluationCache<Result>::KeyHash::operator()(const Eigen::VectorXd* x) const
+{
+    return internal::hash_point(*x);
+}
+
+template <typename Result>
+bool EvaluationCache<Result>::KeyEqual::operator()(
+    const Eigen::VectorXd* a, const Eigen::VectorXd* b) const
+{
+    return internal::points_equal(*a, *b);
+}
+
+template <typename Result>
+EvaluationStore<Result>::EvaluationStore(const std::string& path)
+    : m_path(path)
+{
+    load();
+    m_file.open(m_path, std::ios::binary | std::ios::app);
+    if (!m_file) {
+        throw std::runtime_error("cannot open evaluation store: " + m_path);
+    }
+}
+
+template <typename Result> void EvaluationStore<Result>::load()
+{
+    const std::string magic = internal::store_magic(Result());
+
+    std::ifstream in(m_path, std::ios::binary);
+    const bool exists = bool(in);
+    std::string header(magic.size(), '\0');
+    if (!exists || !in.read(&header[0], header.size())) {
+        // A store interrupted while being created holds only part of the
+        // header, so it is created again.
+        const size_t header_size = exists ? size_t(in.gcount()) : 0;
+        if (magic.compare(0, header_size, header, 0, header_size) != 0) {
+            throw std::runtime_error("invalid evaluation store: " + m_path);
+        }
+        in.close();
+
+        // A new store: write the header.
+        std::ofstream out(m_path, std::ios::binary | std::ios::trunc);
+        out.write(magic.data(), magic.size());
+        if (!out) {
+            throw std::runtime_error(
+                "cannot create evaluation store: " + m_path);
+        }
+        return;
+    }
+    if (header != magic) {
+        throw std::runtime_error("invalid evaluation store: " + m_path);
+    }
+
+    bool truncated = false;
+    Eigen::VectorXd x;
+    Result value;
+    while (in.peek() != std::ifstream::traits_type::eof()) {
+        if (!internal::read_vector(in, x) || !internal::read_value(in, value)) {
+            truncated = true;
+            break;
+        }
+        m_values[x] = value;
+    }
+    in.close();
+
+    if (truncated) {
+        // Rewrite the complete records, so new ones are appended after them.
+        std::ofstream out(m_path, std::ios::binary | std::ios::trunc);
+        out.write(magic.data(), magic.size());
+        for (const auto& entry : m_values) {
+            internal::write_vector(out, entry.first);
+            internal::write_value(out, entry.second);
+        }
+        if (!out) {
+            throw std::runtime_error(
+                "cannot repair evaluation store: " + m_path);
+        }
+    }
+}
+
+template <typename Result>
+template <typename Function>
+CachedFunction<Function, EvaluationStore<Result>>
+EvaluationStore<Result>::wrap(const Function& f)
+{
+    return CachedFunction<Function, EvaluationStore<Result>>(f, *this);
+}
+
+template <typename Result>
+template <typename Function>
+Result
+EvaluationStore<Result>::evaluate(const Function& f, const Eigen::VectorXd& x)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto found = m_values.find(x);
+        if (found != m_values.end()) {
+            m_hits++;
+            return found->second;
+        }
+        m_misses++;
+    }
+
+    // Evaluate outside the lock so concurrent misses do not serialize.
+    Result value = f(x);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_values.emplace(x, value).second) {
+        // Flush every record, so an interrupted run loses at most the
+        // evaluations in progress.
+        internal::write_vector(m_file, x);
+        internal::write_value(m_file, value);
+        m_file.flush();
+        if (!m_file) {
+            throw std::runtime_error(
+                "cannot write evaluation store: " + m_path);
+        }
+    }
+    return value;
+}
+
+template <typename Result> size_t EvaluationStore<Result>::hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+template <typename Result> size_t EvaluationStore<Result>::misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+template <typename Result> size_t EvaluationStore<Result>::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_values.size();
+}
+
+template <typename Result>
+size_t
+EvaluationStore<Result>::KeyHash::operator()(const Eigen::VectorXd& x) const
+{
+    return internal::hash_point(x);
+}
+
+template <typename Result>
+bool EvaluationStore<Result>::KeyEqual::operator()(
+    const Eigen::VectorXd& a, const Eigen::VectorXd& b) const
+{
+    return internal::points_equal(a, b);
+}
+
+} // namespace fd
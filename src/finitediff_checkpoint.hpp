@@ -0,0 +1,95 @@
+/**
+ * @brief Functions to compute derivatives that checkpoint their progress.
+ *
+ * Long running jacobians and hessians are computed in blocks of columns or
+ * rows, and every completed block is appended to a checkpoint file. Calling
+ * the function again with the same arguments and file skips the blocks in the
+ * file, so a job that is interrupted (e.g., by preemption) resumes where it
+ * stopped.
+ */
+#pragma once
+
+#include "finitediff.hpp"
+
+#include <string>
+
+#include <Eigen/Core>
+
+namespace fd {
+
+/**
+ * @brief Compute the jacobian of a function using finite differences,
+ *        checkpointing the completed columns to a file.
+ *
+ * The columns are computed in blocks of checkpoint_interval columns, and each
+ * block is appended to the checkpoint file and flushed once complete. If the
+ * file exists, its blocks are loaded instead of being computed again. The
+ * file is kept afterwards, so it must be removed to start over. The result is
+ * identical to finite_jacobian.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x                    Point at which to compute the jacobian.
+ * @param[in]  f                    Compute the jacobian of this function.
+ * @param[out] jac                  Computed jacobian.
+ * @param[in]  checkpoint_path      Path of the checkpoint file.
+ * @param[in]  accuracy             Accuracy of the finite differences.
+ * @param[in]  eps                  Value of the finite difference step.
+ * @param[in]  num_threads          Number of threads to share the columns of
+ *                                  a block (0 uses all hardware threads). If
+ *                                  not 1, f must be safe to call concurrently.
+ * @param[in]  checkpoint_interval  Number of columns per checkpoint.
+ * @throws std::runtime_error if the checkpoint file cannot be written or was
+ *         written for a different x, accuracy, or eps.
+ */
+template <typename Function>
+void finite_jacobian_resumable(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    const std::string& checkpoint_path,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8,
+    const unsigned num_threads = 1,
+    const Eigen::Index checkpoint_interval = 1);
+
+/**
+ * @brief Compute the hessian of a function using finite differences,
+ *        checkpointing the completed rows to a file.
+ *
+ * The rows of the upper triangle are computed in blocks of
+ * checkpoint_interval rows, and each block is appended to the checkpoint file
+ * and flushed once complete. If the file exists, its blocks are loaded instead
+ * of being computed again. The file is kept afterwards, so it must be removed
+ * to start over. The result is identical to finite_hessian, but f(x) is
+ * evaluated once per block instead of once overall.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x                    Point at which to compute the hessian.
+ * @param[in]  f                    Compute the hessian of this function.
+ * @param[out] hess                 Computed hessian.
+ * @param[in]  checkpoint_path      Path of the checkpoint file.
+ * @param[in]  accuracy             Accuracy of the finite differences.
+ * @param[in]  eps                  Value of the finite difference step.
+ * @param[in]  num_threads          Number of threads to share the entries of
+ *                                  a block (0 uses all hardware threads). If
+ *                                  not 1, f must be safe to call concurrently.
+ * @param[in]  stencil              Stencil used for the entries.
+ * @param[in]  checkpoint_interval  Number of rows per checkpoint.
+ * @throws std::runtime_error if the checkpoint file cannot be written or was
+ *         written for a different x, accuracy, eps, or stencil.
+ */
+template <typename Function>
+void finite_hessian_resumable(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    const std::string& checkpoint_path,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5,
+    const unsigned num_threads = 1,
+    const HessianStencil stencil = FULL_STENCIL,
+    const Eigen::Index checkpoint_interval = 1);
+
+} // namespace fd
+
+#include "finitediff_checkpoint.tpp"
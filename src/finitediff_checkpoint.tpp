@@ -0,0 +1,360 @@
+// Checkpointed finite difference implementation.
+#pragma once
+
+#include "finitediff_checkpoint.hpp"
+#include "finitediff_io.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fd {
+
+namespace internal {
+
+    // A block [begin, end) of columns or rows read from a checkpoint.
+    struct CheckpointBlock {
+        Eigen::Index begin;
+        Eigen::Index end;
+        Eigen::VectorXd values;
+    };
+
+    // Append-only checkpoint file. It starts with a magic string and a
+    // description of the computation (its arguments encoded as a vector),
+    // followed by a record per completed block: begin, end, and the values.
+    class CheckpointFile {
+    public:
+        CheckpointFile(
+            const std::string& path,
+            const std::string& magic,
+            const Eigen::VectorXd& description,
+            const Eigen::Index size)
+            : m_path(path)
+        {
+            std::ifstream in(m_path, std::ios::binary);
+            if (!in || !load(in, magic, description, size)) {
+                in.close();
+                create(magic, description);
+            }
+
+            m_file.open(m_path, std::ios::binary | std::ios::app);
+            if (!m_file) {
+                throw std::runtime_error("cannot open checkpoint: " + m_path);
+            }
+        }
+
+        const std::vector<CheckpointBlock>& blocks() const { return m_blocks; }
+
+        // Append a completed block, flushing it so it survives an
+        // interruption right after.
+        void append(
+            const Eigen::Index begin,
+            const Eigen::Index end,
+            const Eigen::VectorXd& values)
+        {
+            const int64_t range[2] = { begin, end };
+            m_file.write(reinterpret_cast<const char*>(range), sizeof(range));
+            write_vector(m_file, values);
+            m_file.flush();
+            if (!m_file) {
+                throw std::runtime_error("cannot write checkpoint: " + m_path);
+            }
+        }
+
+    protected:
+        // Write the header to a temporary file and rename it into place, so
+        // an interruption never leaves a partial header behind.
+        void create(
+            const std::string& magic, const Eigen::VectorXd& description)
+        {
+            const std::string tmp_path = m_path + ".tmp";
+            {
+                std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+                out.write(magic.data(), magic.size());
+                write_vector(out, description);
+                if (!out.flush()) {
+                    throw std::runtime_error(
+                        "cannot create checkpoint: " + m_path);
+                }
+            }
+            // Replace an incomplete header left by an older interruption.
+            std::remove(m_path.c_str());
+            if (std::rename(tmp_path.c_str(), m_path.c_str()) != 0) {
+                throw std::runtime_error("cannot create checkpoint: " + m_path);
+            }
+        }
+
+        // Load the completed blocks. Returns false if the header is
+        // incomplete, i.e., the checkpoint was interrupted while being
+        // created and holds no blocks.
+        bool load(
+            std::ifstream& in,
+            const std::string& magic,
+            const Eigen::VectorXd& description,
+            const Eigen::Index size)
+        {
+            std::string header(magic.size(), '\0');
+            if (!in.read(&header[0], header.size())) {
+                const size_t header_size = size_t(in.gcount());
+                if (magic.compare(0, header_size, header, 0, header_size)
+                    != 0) {
+                    throw std::runtime_error("invalid checkpoint: " + m_path);
+                }
+                return false;
+            }
+            if (header != magic) {
+                throw std::runtime_error("invalid checkpoint: " + m_path);
+            }
+
+            Eigen::VectorXd file_description;
+            if (!read_vector(in, file_description)) {
+                return false;
+            }
+            if (!points_equal(file_description, description)) {
+                throw std::runtime_error(
+                    "checkpoint of a different computation: " + m_path);
+            }
+
+            // A record cut short by an interruption is dropped.
+            std::streamoff valid_bytes = in.tellg();
+            bool truncated = false;
+            while (in.peek() != std::ifstream::traits_type::eof()) {
+                int64_t range[2];
+                CheckpointBlock block;
+                if (!in.read(reinterpret_cast<char*>(range), sizeof(range))
+                    || !read_vector(in, block.values)) {
+                    truncated = true;
+                    break;
+                }
+                if (range[0] < 0 || range[0] >= range[1] || range[1] > size) {
+                    throw std::runtime_error("invalid checkpoint: " + m_path);
+                }
+                block.begin = Eigen::Index(range[0]);
+                block.end = Eigen::Index(range[1]);
+                m_blocks.push_back(std::move(block));
+                valid_bytes = in.tellg();
+            }
+
+            if (truncated) {
+                // Rewrite the complete records, so new ones are appended
+                // after them.
+                in.clear();
+                in.seekg(0);
+                std::string contents(size_t(valid_bytes), '\0');
+                in.read(&contents[0], valid_bytes);
+                in.close();
+                std::ofstream out(m_path, std::ios::binary | std::ios::trunc);
+                out.write(contents.data(), valid_bytes);
+                if (!out) {
+                    throw std::runtime_error(
+                        "cannot repair checkpoint: " + m_path);
+                }
+            }
+            return true;
+        }
+
+        std::string m_path;
+        std::ofstream m_file;
+        std::vector<CheckpointBlock> m_blocks;
+    };
+
+    // Compute the rows [row_begin, row_end) of the upper triangle of the
+    // hessian, with the stencil chosen at run time.
+    template <typename Function, typename Store>
+    void hessian_rows(
+        const Eigen::Ref<const Eigen::VectorXd>& x,
+        const Function& f,
+        const Store& store,
+        const AccuracyOrder accuracy,
+        const double eps,
+        const unsigned num_threads,
+        Eigen::VectorXd* x_buffers,
+        const HessianStencil stencil,
+        const Eigen::Index row_begin,
+        const Eigen::Index row_end)
+    {
+        switch (accuracy) {
+        case SECOND:
+            return hessian_with_stencil<SECOND>(
+                x, f, store, eps, num_threads, x_buffers, stencil, x.size(),
+                row_begin, row_end);
+        case FOURTH:
+            return hessian_with_stencil<FOURTH>(
+                x, f, store, eps, num_threads, x_buffers, stencil, x.size(),
+                row_begin, row_end);
+        case SIXTH:
+            return hessian_with_stencil<SIXTH>(
+                x, f, store, eps, num_threads, x_buffers, stencil, x.size(),
+                row_begin, row_end);
+        case EIGHTH:
+            return hessian_with_stencil<EIGHTH>(
+                x, f, store, eps, num_threads, x_buffers, stencil, x.size(),
+                row_begin, row_end);
+        default:
+            throw std::invalid_argument("invalid accuracy order");
+        }
+    }
+
+    // Number of entries (i, i..n-1) in the rows [begin, end) of the upper
+    // triangle.
+    inline Eigen::Index upper_rows_size(
+        const Eigen::Index n, const Eigen::Index begin, const Eigen::Index end)
+    {
+        return (end - begin) * n - (end * (end - 1) - begin * (begin - 1)) / 2;
+    }
+
+    // Whether every entry in [begin, end) of done is set.
+    inline bool all_done(
+        const std::vector<bool>& done,
+        const Eigen::Index begin,
+        const Eigen::Index end)
+    {
+        return std::find(done.begin() + begin, done.begin() + end, false)
+            == done.begin() + end;
+    }
+
+} // namespace internal
+
+template <typename Function>
+void finite_jacobian_resumable(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& jac,
+    const std::string& checkpoint_path,
+    const AccuracyOrder accuracy,
+    const double eps,
+    const unsigned num_threads,
+    const Eigen::Index checkpoint_interval)
+{
+    assert(checkpoint_interval > 0);
+    const Eigen::Index n = x.size();
+    if (n == 0) {
+        // There are no columns to checkpoint.
+        return finite_jacobian(x, f, jac, accuracy, eps, num_threads);
+    }
+
+    Eigen::VectorXd description(n + 2);
+    description << double(accuracy), eps, x;
+    internal::CheckpointFile checkpoint(
+        checkpoint_path, "fdjacck1", description, n);
+
+    // The number of rows is only known from a block or an evaluation of f.
+    bool sized = false;
+    std::vector<bool> done(n, false);
+    for (const internal::CheckpointBlock& block : checkpoint.blocks()) {
+        const Eigen::Index cols = block.end - block.begin;
+        const Eigen::Index rows = block.values.size() / cols;
+        if (!sized) {
+            jac.setZero(rows, n);
+            sized = true;
+        }
+        if (rows != jac.rows() || rows * cols != block.values.size()) {
+            throw std::runtime_error("invalid checkpoint: " + checkpoint_path);
+        }
+        jac.middleCols(block.begin, cols) =
+            Eigen::Map<const Eigen::MatrixXd>(block.values.data(), rows, cols);
+        std::fill(done.begin() + block.begin, done.begin() + block.end, true);
+    }
+
+    Eigen::MatrixXd block_jac;
+    for (Eigen::Index begin = 0; begin < n; begin += checkpoint_interval) {
+        const Eigen::Index end = std::min(begin + checkpoint_interval, n);
+        if (internal::all_done(done, begin, end)) {
+            continue;
+        }
+        const Eigen::Index cols = end - begin;
+
+        // f as a function of the coordinates of the block only, so the
+        // columns are computed exactly as by finite_jacobian.
+        const auto f_block = [&](const Eigen::VectorXd& y) -> Eigen::VectorXd {
+            Eigen::VectorXd z = x;
+            z.segment(begin, cols) = y;
+            return f(z);
+        };
+        finite_jacobian(
+            x.segment(begin, cols), f_block, block_jac, accuracy, eps,
+            num_threads);
+
+        if (!sized) {
+            jac.setZero(block_jac.rows(), n);
+            sized = true;
+        }
+        jac.middleCols(begin, cols) = block_jac;
+        checkpoint.append(
+            begin, end,
+            Eigen::Map<const Eigen::VectorXd>(
+                block_jac.data(), block_jac.size()));
+    }
+}
+
+template <typename Function>
+void finite_hessian_resumable(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    Eigen::MatrixXd& hess,
+    const std::string& checkpoint_path,
+    const AccuracyOrder accuracy,
+    const double eps,
+    unsigned num_threads,
+    const HessianStencil stencil,
+    const Eigen::Index checkpoint_interval)
+{
+    assert(checkpoint_interval > 0);
+    const Eigen::Index n = x.size();
+
+    Eigen::VectorXd description(n + 3);
+    description << double(accuracy), double(stencil), eps, x;
+    internal::CheckpointFile checkpoint(
+        checkpoint_path, "fdhesck1", description, n);
+
+    hess.setZero(n, n);
+    const internal::DenseHessianStore<Eigen::MatrixXd> store = { hess };
+
+    // Each row i of a block holds the entries (i, i..n-1).
+    std::vector<bool> done(n, false);
+    for (const internal::CheckpointBlock& block : checkpoint.blocks()) {
+        const Eigen::Index size =
+            internal::upper_rows_size(n, block.begin, block.end);
+        if (size != block.values.size()) {
+            throw std::runtime_error("invalid checkpoint: " + checkpoint_path);
+        }
+        Eigen::Index k = 0;
+        for (Eigen::Index i = block.begin; i < block.end; i++) {
+            for (Eigen::Index j = i; j < n; j++) {
+                store(i, j, block.values[k++]);
+            }
+        }
+        std::fill(done.begin() + block.begin, done.begin() + block.end, true);
+    }
+
+    const size_t num_entries = size_t(n) * size_t(n + 1) / 2;
+    num_threads = internal::resolve_num_threads(num_threads, num_entries);
+    Workspace workspace;
+    Eigen::VectorXd* x_buffers = workspace.perturbation_buffers(n, num_threads);
+
+    Eigen::VectorXd values;
+    for (Eigen::Index begin = 0; begin < n; begin += checkpoint_interval) {
+        const Eigen::Index end = std::min(begin + checkpoint_interval, n);
+        if (internal::all_done(done, begin, end)) {
+            continue;
+        }
+
+        internal::hessian_rows(
+            x, f, store, accuracy, eps, num_threads, x_buffers, stencil, begin,
+            end);
+
+        values.resize(internal::upper_rows_size(n, begin, end));
+        Eigen::Index k = 0;
+        for (Eigen::Index i = begin; i < end; i++) {
+            values.segment(k, n - i) = hess.row(i).tail(n - i).transpose();
+            k += n - i;
+        }
+        checkpoint.append(begin, end, values);
+    }
+}
+
+} // namespace fd
@@ -0,0 +1,58 @@
+// Binary I/O shared by the evaluation store and checkpoint files.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+#include <Eigen/Core>
+
+namespace fd {
+
+namespace internal {
+
+    // Whether two points are bitwise identical.
+    inline bool points_equal(const Eigen::VectorXd& a, const Eigen::VectorXd& b)
+    {
+        return a.size() == b.size()
+            && std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+    }
+
+    // Write a vector as its size followed by its values, in native byte
+    // order.
+    inline void write_vector(std::ostream& out, const Eigen::VectorXd& v)
+    {
+        const int64_t size = v.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(
+            reinterpret_cast<const char*>(v.data()), size * sizeof(double));
+    }
+
+    // Number of bytes left to read in a seekable stream.
+    inline std::streamoff remaining_bytes(std::istream& in)
+    {
+        const std::streampos position = in.tellg();
+        in.seekg(0, std::ios::end);
+        const std::streamoff remaining = in.tellg() - position;
+        in.seekg(position);
+        return remaining;
+    }
+
+    // Read a vector, failing instead of allocating if its size is torn or
+    // corrupted (i.e., larger than the rest of the stream).
+    inline bool read_vector(std::istream& in, Eigen::VectorXd& v)
+    {
+        int64_t size;
+        if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)) || size < 0
+            || size > remaining_bytes(in) / std::streamoff(sizeof(double))) {
+            return false;
+        }
+        v.resize(size);
+        return bool(
+            in.read(reinterpret_cast<char*>(v.data()), size * sizeof(double)));
+    }
+
+} // namespace internal
+
+} // namespace fd
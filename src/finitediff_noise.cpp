@@ -0,0 +1,107 @@
+// Functions to estimate the noise of a function.
+#include "finitediff_noise.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace fd {
+
+double NoiseEstimate::relative_noise() const
+{
+    return noise / std::max(std::abs(value), 1.0);
+}
+
+StepSize NoiseEstimate::step_size(const Eigen::VectorXd& typical_x) const
+{
+    if (status != NOISE_DETECTED) {
+        return StepSize::optimal(
+            std::numeric_limits<double>::epsilon(), typical_x);
+    }
+    return StepSize::optimal(relative_noise(), typical_x);
+}
+
+// Estimate the noise from the levels of the difference table (ECnoise).
+NoiseEstimate
+estimate_noise_from_values(const Eigen::Ref<const Eigen::VectorXd>& values)
+{
+    const Eigen::Index num_points = values.size();
+    assert(num_points >= 4);
+
+    NoiseEstimate estimate;
+    estimate.status = NOISE_SPACING_TOO_LARGE;
+    estimate.noise = 0;
+    estimate.value = values[(num_points - 1) / 2];
+    estimate.order = 0;
+
+    // The values must not vary by more than 10%.
+    const double f_min = values.minCoeff(), f_max = values.maxCoeff();
+    if (f_max - f_min > 0.1 * std::max(std::abs(f_min), std::abs(f_max))) {
+        return estimate;
+    }
+
+    // The k-th differences of noise with standard deviation σ have mean square
+    // σ² / γₖ, where γₖ = (k!)² / (2k)!.
+    Eigen::VectorXd differences = values;
+    std::vector<double> levels(num_points - 1);
+    std::vector<bool> sign_changes(num_points - 1);
+    double gamma = 1;
+    for (Eigen::Index k = 1; k < num_points; k++) {
+        const Eigen::Index m = num_points - k;
+        for (Eigen::Index i = 0; i < m; i++) {
+            differences[i] = differences[i + 1] - differences[i];
+        }
+        const auto head = differences.head(m);
+
+        if (k == 1 && 2 * (head.array() == 0).count() >= num_points) {
+            estimate.status = NOISE_SPACING_TOO_SMALL;
+            return estimate;
+        }
+
+        gamma *= 0.5 * double(k) / double(2 * k - 1);
+        levels[k - 1] = std::sqrt(gamma * head.squaredNorm() / double(m));
+        sign_changes[k - 1] = head.minCoeff() * head.maxCoeff() < 0;
+    }
+
+    // The noise is the first level that agrees with the next two, where the
+    // differences also change sign, as noise does.
+    for (Eigen::Index k = 0; k + 2 < num_points - 1; k++) {
+        const auto three = levels.begin() + k;
+        const double level_min = *std::min_element(three, three + 3);
+        const double level_max = *std::max_element(three, three + 3);
+        if (level_max <= 4 * level_min && sign_changes[k]) {
+            estimate.status = NOISE_DETECTED;
+            estimate.noise = levels[k];
+            estimate.order = int(k + 1);
+            return estimate;
+        }
+    }
+    return estimate;
+}
+
+NoiseAdaptiveStep::NoiseAdaptiveStep(
+    const double spacing,
+    const int num_points,
+    const int max_attempts,
+    const Eigen::VectorXd& typical_x)
+    : m_spacing(spacing)
+    , m_num_points(num_points)
+    , m_max_attempts(max_attempts)
+    , m_typical_x(typical_x)
+    , m_estimate()
+    , m_step_size(StepSize::optimal(
+          std::numeric_limits<double>::epsilon(), typical_x))
+{
+    assert(spacing > 0 && num_points >= 4 && max_attempts > 0);
+}
+
+void NoiseAdaptiveStep::set_estimate(const NoiseEstimate& estimate)
+{
+    m_estimate = estimate;
+    m_step_size = estimate.step_size(m_typical_x);
+    m_has_estimate = true;
+}
+
+} // namespace fd
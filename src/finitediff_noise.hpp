@@ -0,0 +1,161 @@
+/**
+ * @brief Functions to estimate the noise of a function and adapt the finite
+ *        difference steps to it.
+ *
+ * Objectives computed by iterative solvers or simulations are only accurate
+ * to a noise level far above machine precision, and steps chosen for exact
+ * functions amplify that noise. The noise is estimated from a difference
+ * table of values at equally spaced points on a line (ECnoise, Moré and Wild,
+ * 2011), and turned into a StepSize for the finite difference drivers.
+ */
+#pragma once
+
+#include "finitediff.hpp"
+
+#include <Eigen/Core>
+
+namespace fd {
+
+/**
+ * @brief Enumeration of the outcomes of a noise estimate.
+ */
+enum NoiseStatus {
+    /// @brief The noise level was estimated.
+    NOISE_DETECTED,
+    /// @brief Too many of the values are equal: retry with a larger spacing.
+    NOISE_SPACING_TOO_SMALL,
+    /// @brief The differences are dominated by the smooth part of f: retry
+    ///        with a smaller spacing.
+    NOISE_SPACING_TOO_LARGE
+};
+
+/**
+ * @brief Estimated noise of a function.
+ */
+struct NoiseEstimate {
+    /// @brief Outcome of the estimate.
+    NoiseStatus status;
+    /// @brief Standard deviation of the noise (0 unless detected).
+    double noise;
+    /// @brief Value of f at the middle point.
+    double value;
+    /// @brief Order of the differences the noise was estimated from.
+    int order;
+
+    /// @brief Noise relative to max(|value|, 1).
+    double relative_noise() const;
+
+    /**
+     * @brief Get the steps balancing truncation and noise.
+     *
+     * @param[in] typical_x  Nonzero typical magnitude of each coordinate
+     *                       (empty for all ones).
+     *
+     * @return StepSize::optimal() of the relative noise, or of machine epsilon
+     *         if no noise was detected.
+     */
+    StepSize step_size(const Eigen::VectorXd& typical_x = Eigen::VectorXd())
+        const;
+};
+
+/**
+ * @brief Estimate the noise of a function from its values at equally spaced
+ *        points on a line.
+ *
+ * @param[in] values  Values of f at x + i h p, i = 0, ..., at least 4 (ECnoise
+ *                    recommends 9).
+ *
+ * @return The estimated noise.
+ */
+NoiseEstimate
+estimate_noise_from_values(const Eigen::Ref<const Eigen::VectorXd>& values);
+
+/**
+ * @brief Estimate the noise of a function from its values at equally spaced
+ *        points on a line through x.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in] x           Point at the middle of the line.
+ * @param[in] f           Function to estimate the noise of.
+ * @param[in] direction   Direction of the line.
+ * @param[in] spacing     Distance between the points along direction.
+ * @param[in] num_points  Number of points (at least 4).
+ *
+ * @return The estimated noise.
+ */
+template <typename Function>
+NoiseEstimate estimate_noise(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& direction,
+    const double spacing = 1.0e-6,
+    const int num_points = 9);
+
+/**
+ * @brief Steps adapted to the noise of a function, estimated once per
+ *        problem.
+ *
+ * The first call to step_size() estimates the noise at its x, retrying with a
+ * larger or smaller spacing if needed, and later calls reuse the estimate, so
+ * an optimizer can call it every iteration:
+ *
+ *     NoiseAdaptiveStep step;
+ *     finite_gradient(x, f, grad, SECOND, step.step_size(x, f));
+ */
+class NoiseAdaptiveStep {
+public:
+    /**
+     * @brief Construct without an estimate.
+     *
+     * @param[in] spacing       Initial distance between the points.
+     * @param[in] num_points    Number of points per attempt.
+     * @param[in] max_attempts  Maximum number of spacings to try.
+     * @param[in] typical_x     Nonzero typical magnitude of each coordinate
+     *                          (empty for all ones).
+     */
+    explicit NoiseAdaptiveStep(
+        const double spacing = 1.0e-6,
+        const int num_points = 9,
+        const int max_attempts = 4,
+        const Eigen::VectorXd& typical_x = Eigen::VectorXd());
+
+    /**
+     * @brief Get the steps, estimating the noise along the diagonal direction
+     *        if there is no estimate yet.
+     *
+     * @tparam Function  Callable as double(const Eigen::VectorXd&).
+     * @param[in] x  Point at which derivatives are computed.
+     * @param[in] f  Function to differentiate.
+     *
+     * @return The steps of the estimated noise.
+     */
+    template <typename Function>
+    const StepSize&
+    step_size(const Eigen::Ref<const Eigen::VectorXd>& x, const Function& f);
+
+    /// @brief Whether the noise was estimated.
+    bool has_estimate() const { return m_has_estimate; }
+
+    /// @brief The last estimate of the noise.
+    const NoiseEstimate& estimate() const { return m_estimate; }
+
+    /// @brief Discard the estimate, e.g., when the problem changes.
+    void reset() { m_has_estimate = false; }
+
+protected:
+    /// @brief Cache the estimate and its steps.
+    void set_estimate(const NoiseEstimate& estimate);
+
+    double m_spacing;
+    int m_num_points;
+    int m_max_attempts;
+    Eigen::VectorXd m_typical_x;
+
+    bool m_has_estimate = false;
+    NoiseEstimate m_estimate;
+    StepSize m_step_size;
+};
+
+} // namespace fd
+
+#include "finitediff_noise.tpp"
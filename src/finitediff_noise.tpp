@@ -0,0 +1,59 @@
+// Templated noise estimation.
+#pragma once
+
+#include "finitediff_noise.hpp"
+
+#include <cassert>
+#include <cmath>
+
+namespace fd {
+
+template <typename Function>
+NoiseEstimate estimate_noise(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::Ref<const Eigen::VectorXd>& direction,
+    const double spacing,
+    const int num_points)
+{
+    assert(direction.size() == x.size());
+    assert(num_points >= 4);
+
+    // The middle point is x itself for an odd number of points.
+    const int middle = (num_points - 1) / 2;
+    Eigen::VectorXd values(num_points);
+    Eigen::VectorXd point(x.size());
+    for (int i = 0; i < num_points; i++) {
+        point = x + (double(i - middle) * spacing) * direction;
+        values[i] = f(point);
+    }
+    return estimate_noise_from_values(values);
+}
+
+template <typename Function>
+const StepSize& NoiseAdaptiveStep::step_size(
+    const Eigen::Ref<const Eigen::VectorXd>& x, const Function& f)
+{
+    if (m_has_estimate) {
+        return m_step_size;
+    }
+
+    const Eigen::VectorXd direction =
+        Eigen::VectorXd::Ones(x.size()) / std::sqrt(double(x.size()));
+    double spacing = m_spacing;
+    NoiseEstimate estimate;
+    for (int attempt = 0; attempt < m_max_attempts; attempt++) {
+        estimate = estimate_noise(x, f, direction, spacing, m_num_points);
+        if (estimate.status == NOISE_SPACING_TOO_SMALL) {
+            spacing *= 100;
+        } else if (estimate.status == NOISE_SPACING_TOO_LARGE) {
+            spacing /= 100;
+        } else {
+            break;
+        }
+    }
+    set_estimate(estimate);
+    return m_step_size;
+}
+
+} // namespace fd
@@ -0,0 +1,104 @@
+// Functions to compute sparse derivatives using finite difference.
+#include "finitediff_sparse.hpp"
+
+#include <cassert>
+
+namespace fd {
+
+// Greedily color the columns of a sparsity pattern (Curtis–Powell–Reid).
+std::vector<int> color_columns(
+    const Eigen::SparseMatrix<double>& sparsity, int& num_colors)
+{
+    // Row-major copy to find the columns sharing a row with a column.
+    const Eigen::SparseMatrix<double, Eigen::RowMajor> rows = sparsity;
+
+    std::vector<int> colors(sparsity.cols(), -1);
+    // forbidden[c] == j if color c is used by a neighbor of column j.
+    std::vector<Eigen::Index> forbidden;
+
+    num_colors = 0;
+    for (Eigen::Index j = 0; j < sparsity.cols(); j++) {
+        for (Eigen::SparseMatrix<double>::InnerIterator it(sparsity, j); it;
+             ++it) {
+            for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator
+                     row_it(rows, it.row());
+                 row_it; ++row_it) {
+                const int c = colors[row_it.col()];
+                if (c >= 0) {
+                    forbidden[c] = j;
+                }
+            }
+        }
+
+        int c = 0;
+        while (c < num_colors && forbidden[c] == j) {
+            c++;
+        }
+        if (c == num_colors) {
+            forbidden.push_back(-1);
+            num_colors++;
+        }
+        colors[j] = c;
+    }
+
+    return colors;
+}
+
+// Greedily star color the columns of a symmetric sparsity pattern.
+std::vector<int> star_color_columns(
+    const Eigen::SparseMatrix<double>& sparsity, int& num_colors)
+{
+    typedef Eigen::SparseMatrix<double>::InnerIterator Iterator;
+
+    assert(sparsity.rows() == sparsity.cols());
+
+    std::vector<int> colors(sparsity.cols(), -1);
+    // forbidden[c] == v if color c cannot be used for column v.
+    std::vector<Eigen::Index> forbidden;
+
+    num_colors = 0;
+    for (Eigen::Index v = 0; v < sparsity.cols(); v++) {
+        for (Iterator w_it(sparsity, v); w_it; ++w_it) {
+            const Eigen::Index w = w_it.row();
+            if (w == v) {
+                continue;
+            }
+            if (colors[w] >= 0) {
+                forbidden[colors[w]] = v; // Distance-1 neighbor
+            }
+            for (Iterator x_it(sparsity, w); x_it; ++x_it) {
+                const Eigen::Index x = x_it.row();
+                if (x == w || x == v || colors[x] < 0) {
+                    continue;
+                }
+                if (colors[w] < 0) {
+                    // v and x will be connected through an uncolored w.
+                    forbidden[colors[x]] = v;
+                    continue;
+                }
+                // Avoid the bicolored path v - w - x - y.
+                for (Iterator y_it(sparsity, x); y_it; ++y_it) {
+                    const Eigen::Index y = y_it.row();
+                    if (y != x && y != w && colors[y] == colors[w]) {
+                        forbidden[colors[x]] = v;
+                        break;
+                    }
+                }
+            }
+        }
+
+        int c = 0;
+        while (c < num_colors && forbidden[c] == v) {
+            c++;
+        }
+        if (c == num_colors) {
+            forbidden.push_back(-1);
+            num_colors++;
+        }
+        colors[v] = c;
+    }
+
+    return colors;
+}
+
+} // namespace fd
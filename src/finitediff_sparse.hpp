@@ -0,0 +1,180 @@
+/**
+ * @brief Functions to compute sparse derivatives using finite difference.
+ *
+ * Columns that are structurally orthogonal (i.e., share no nonzero rows) are
+ * perturbed together, so the number of function evaluations depends on the
+ * number of colors instead of the number of variables.
+ */
+#pragma once
+
+#include "finitediff.hpp"
+
+#include <vector>
+
+#include <Eigen/SparseCore>
+
+namespace fd {
+
+/**
+ * @brief Greedily color the columns of a sparsity pattern such that columns
+ *        of the same color share no nonzero rows (Curtis–Powell–Reid).
+ *
+ * @param[in]  sparsity    Sparsity pattern (the values are ignored).
+ * @param[out] num_colors  Number of colors used.
+ *
+ * @return The color, in [0, num_colors), of each column.
+ */
+std::vector<int> color_columns(
+    const Eigen::SparseMatrix<double>& sparsity, int& num_colors);
+
+/**
+ * @brief Greedily star color the columns of a symmetric sparsity pattern.
+ *
+ * In a star coloring, adjacent columns have different colors and every path
+ * of four columns uses at least three colors. For every off-diagonal nonzero
+ * (i, j), either j is the only neighbor of i with its color or i is the only
+ * neighbor of j with its color, so a symmetric matrix can be recovered
+ * directly from its product with the color indicator vectors.
+ * See Gebremedhin et al., "What Color Is Your Jacobian?" (2005), Alg. 4.1.
+ *
+ * @param[in]  sparsity    Symmetric sparsity pattern (the values are ignored).
+ * @param[out] num_colors  Number of colors used.
+ *
+ * @return The color, in [0, num_colors), of each column.
+ */
+std::vector<int> star_color_columns(
+    const Eigen::SparseMatrix<double>& sparsity, int& num_colors);
+
+/**
+ * @brief Compute a sparse jacobian of a function using finite differences.
+ *
+ * Uses colors * k evaluations of f, where k is the number of points in the
+ * stencil, instead of n * k.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the jacobian.
+ * @param[in]  f         Compute the jacobian of this function.
+ * @param[in]  sparsity  Sparsity pattern of the m × n jacobian.
+ * @param[out] jac       Computed jacobian with the same pattern as sparsity.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Function>
+void finite_sparse_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::SparseMatrix<double>& sparsity,
+    Eigen::SparseMatrix<double>& jac,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute a sparse jacobian of a function using finite differences
+ *        and a precomputed column coloring.
+ *
+ * Reusing the coloring avoids recoloring the same pattern on every call.
+ *
+ * @tparam Function  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x           Point at which to compute the jacobian.
+ * @param[in]  f           Compute the jacobian of this function.
+ * @param[in]  sparsity    Sparsity pattern of the m × n jacobian.
+ * @param[in]  colors      Column coloring computed by color_columns().
+ * @param[in]  num_colors  Number of colors in the coloring.
+ * @param[out] jac         Computed jacobian with the same pattern as sparsity.
+ * @param[in]  accuracy    Accuracy of the finite differences.
+ * @param[in]  eps         Value of the finite difference step.
+ */
+template <typename Function>
+void finite_sparse_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::SparseMatrix<double>& sparsity,
+    const std::vector<int>& colors,
+    const int num_colors,
+    Eigen::SparseMatrix<double>& jac,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute a sparse hessian of a function using finite differences.
+ *
+ * Each nonzero (i, j) of the upper triangle is a mixed second difference of
+ * k² points along eᵢ and eⱼ, where k is the number of points in the stencil,
+ * so this takes nnz * k² evaluations of f instead of n² / 2 * k², where nnz
+ * is the number of nonzeros in the upper triangle. Prefer
+ * finite_sparse_hessian_from_gradient() if the gradient is available.
+ *
+ * @tparam Function  Callable as double(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  f         Compute the hessian of this function.
+ * @param[in]  sparsity  Symmetric sparsity pattern of the n × n hessian.
+ * @param[out] hess      Computed hessian with the same pattern as sparsity.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Function>
+void finite_sparse_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::SparseMatrix<double>& sparsity,
+    Eigen::SparseMatrix<double>& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-5);
+
+/**
+ * @brief Compute a sparse hessian of a function using finite differences of
+ *        its gradient.
+ *
+ * The columns are star colored, and the gradient is differenced along the
+ * indicator vector d of each color, giving the compressed hessian H D. Every
+ * nonzero is read directly from it, so this takes colors * k evaluations of
+ * the gradient, where k is the number of points in the stencil, instead of
+ * n * k.
+ *
+ * @tparam Gradient  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x         Point at which to compute the hessian.
+ * @param[in]  grad      Gradient of the function whose hessian to compute.
+ * @param[in]  sparsity  Symmetric sparsity pattern of the n × n hessian.
+ * @param[out] hess      Computed hessian with the same pattern as sparsity.
+ * @param[in]  accuracy  Accuracy of the finite differences.
+ * @param[in]  eps       Value of the finite difference step.
+ */
+template <typename Gradient>
+void finite_sparse_hessian_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::SparseMatrix<double>& sparsity,
+    Eigen::SparseMatrix<double>& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+/**
+ * @brief Compute a sparse hessian of a function using finite differences of
+ *        its gradient and a precomputed star coloring.
+ *
+ * Reusing the coloring avoids recoloring the same pattern on every call.
+ *
+ * @tparam Gradient  Callable as Eigen::VectorXd(const Eigen::VectorXd&).
+ * @param[in]  x           Point at which to compute the hessian.
+ * @param[in]  grad        Gradient of the function whose hessian to compute.
+ * @param[in]  sparsity    Symmetric sparsity pattern of the n × n hessian.
+ * @param[in]  colors      Star coloring computed by star_color_columns().
+ * @param[in]  num_colors  Number of colors in the coloring.
+ * @param[out] hess        Computed hessian with the same pattern as sparsity.
+ * @param[in]  accuracy    Accuracy of the finite differences.
+ * @param[in]  eps         Value of the finite difference step.
+ */
+template <typename Gradient>
+void finite_sparse_hessian_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::SparseMatrix<double>& sparsity,
+    const std::vector<int>& colors,
+    const int num_colors,
+    Eigen::SparseMatrix<double>& hess,
+    const AccuracyOrder accuracy = SECOND,
+    const double eps = 1.0e-8);
+
+} // namespace fd
+
+#include "finitediff_sparse.tpp"
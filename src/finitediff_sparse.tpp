@@ -0,0 +1,234 @@
+// Templated sparse finite difference drivers.
+#pragma once
+
+#include "finitediff_sparse.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace fd {
+
+namespace internal {
+
+    // For each color, the columns with that color.
+    inline std::vector<std::vector<Eigen::Index>>
+    group_columns_by_color(const std::vector<int>& colors, const int num_colors)
+    {
+        std::vector<std::vector<Eigen::Index>> columns_of_color(num_colors);
+        for (size_t j = 0; j < colors.size(); j++) {
+            columns_of_color[colors[j]].push_back(j);
+        }
+        return columns_of_color;
+    }
+
+} // namespace internal
+
+template <typename Function>
+void finite_sparse_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::SparseMatrix<double>& sparsity,
+    Eigen::SparseMatrix<double>& jac,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    int num_colors;
+    const std::vector<int> colors = color_columns(sparsity, num_colors);
+    finite_sparse_jacobian(
+        x, f, sparsity, colors, num_colors, jac, accuracy, eps);
+}
+
+template <typename Function>
+void finite_sparse_jacobian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::SparseMatrix<double>& sparsity,
+    const std::vector<int>& colors,
+    const int num_colors,
+    Eigen::SparseMatrix<double>& jac,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    assert(sparsity.cols() == x.size());
+    assert(colors.size() == size_t(x.size()));
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    const double denom = stencil.denominator * eps;
+
+    jac = sparsity;
+    jac.makeCompressed();
+
+    // Compressed jacobian: column c is the directional derivative along the
+    // sum of the unit vectors of the columns with color c.
+    Eigen::MatrixXd compressed = Eigen::MatrixXd::Zero(jac.rows(), num_colors);
+
+    const std::vector<std::vector<Eigen::Index>> columns_of_color =
+        internal::group_columns_by_color(colors, num_colors);
+
+    Eigen::VectorXd x_mutable = x;
+    for (int c = 0; c < num_colors; c++) {
+        for (size_t ci = 0; ci < stencil.size; ci++) {
+            for (const Eigen::Index j : columns_of_color[c]) {
+                x_mutable[j] += stencil.internal_coeffs[ci] * eps;
+            }
+            compressed.col(c) += stencil.external_coeffs[ci] * f(x_mutable);
+            for (const Eigen::Index j : columns_of_color[c]) {
+                x_mutable[j] = x[j];
+            }
+        }
+    }
+    compressed /= denom;
+
+    // Columns of the same color share no rows, so every nonzero is read
+    // directly from the compressed jacobian.
+    for (Eigen::Index j = 0; j < jac.outerSize(); j++) {
+        for (Eigen::SparseMatrix<double>::InnerIterator it(jac, j); it; ++it) {
+            it.valueRef() = compressed(it.row(), colors[j]);
+        }
+    }
+}
+
+template <typename Function>
+void finite_sparse_hessian(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Function& f,
+    const Eigen::SparseMatrix<double>& sparsity,
+    Eigen::SparseMatrix<double>& hess,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    typedef Eigen::SparseMatrix<double>::InnerIterator Iterator;
+
+    assert(sparsity.rows() == x.size() && sparsity.cols() == x.size());
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    double denom = stencil.denominator * eps;
+    denom *= denom;
+
+    hess = sparsity;
+    hess.makeCompressed();
+
+    // Each nonzero (i, j) of the upper triangle is the mixed second difference
+    // along eᵢ and eⱼ.
+    Eigen::VectorXd x_mutable = x;
+    for (Eigen::Index j = 0; j < hess.outerSize(); j++) {
+        for (Iterator it(hess, j); it; ++it) {
+            const Eigen::Index i = it.row();
+            if (i > j) {
+                continue;
+            }
+            double value = 0;
+            for (size_t ci = 0; ci < stencil.size; ci++) {
+                for (size_t cj = 0; cj < stencil.size; cj++) {
+                    x_mutable[i] += stencil.internal_coeffs[ci] * eps;
+                    x_mutable[j] += stencil.internal_coeffs[cj] * eps;
+                    value += stencil.external_coeffs[ci]
+                        * stencil.external_coeffs[cj] * f(x_mutable);
+                    x_mutable[i] = x[i];
+                    x_mutable[j] = x[j];
+                }
+            }
+            it.valueRef() = value / denom;
+        }
+    }
+
+    // Copy the upper triangle to the lower one, so the result is exactly
+    // symmetric.
+    for (Eigen::Index j = 0; j < hess.outerSize(); j++) {
+        for (Iterator it(hess, j); it; ++it) {
+            if (it.row() > j) {
+                it.valueRef() = hess.coeff(j, it.row());
+            }
+        }
+    }
+}
+
+template <typename Gradient>
+void finite_sparse_hessian_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::SparseMatrix<double>& sparsity,
+    Eigen::SparseMatrix<double>& hess,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    int num_colors;
+    const std::vector<int> colors = star_color_columns(sparsity, num_colors);
+    finite_sparse_hessian_from_gradient(
+        x, grad, sparsity, colors, num_colors, hess, accuracy, eps);
+}
+
+template <typename Gradient>
+void finite_sparse_hessian_from_gradient(
+    const Eigen::Ref<const Eigen::VectorXd>& x,
+    const Gradient& grad,
+    const Eigen::SparseMatrix<double>& sparsity,
+    const std::vector<int>& colors,
+    const int num_colors,
+    Eigen::SparseMatrix<double>& hess,
+    const AccuracyOrder accuracy,
+    const double eps)
+{
+    typedef Eigen::SparseMatrix<double>::InnerIterator Iterator;
+
+    assert(sparsity.rows() == x.size() && sparsity.cols() == x.size());
+    assert(colors.size() == size_t(x.size()));
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+    const double denom = stencil.denominator * eps;
+
+    hess = sparsity;
+    hess.makeCompressed();
+
+    // Compressed hessian, B = H D: column c is the directional derivative of
+    // the gradient along the indicator vector d_c of the color c.
+    Eigen::MatrixXd compressed = Eigen::MatrixXd::Zero(x.size(), num_colors);
+
+    const std::vector<std::vector<Eigen::Index>> columns_of_color =
+        internal::group_columns_by_color(colors, num_colors);
+
+    Eigen::VectorXd x_mutable = x;
+    for (int c = 0; c < num_colors; c++) {
+        for (size_t ci = 0; ci < stencil.size; ci++) {
+            for (const Eigen::Index j : columns_of_color[c]) {
+                x_mutable[j] += stencil.internal_coeffs[ci] * eps;
+            }
+            compressed.col(c) += stencil.external_coeffs[ci] * grad(x_mutable);
+            for (const Eigen::Index j : columns_of_color[c]) {
+                x_mutable[j] = x[j];
+            }
+        }
+    }
+    compressed /= denom;
+
+    // neighbor_counts(c, i) is the number of neighbors of i with color c.
+    std::vector<Eigen::Triplet<int>> triplets;
+    triplets.reserve(hess.nonZeros());
+    for (Eigen::Index i = 0; i < hess.outerSize(); i++) {
+        for (Iterator it(hess, i); it; ++it) {
+            if (it.row() != i) {
+                triplets.emplace_back(colors[it.row()], i, 1);
+            }
+        }
+    }
+    Eigen::SparseMatrix<int> neighbor_counts(num_colors, x.size());
+    neighbor_counts.setFromTriplets(triplets.begin(), triplets.end());
+
+    // The diagonal is B(i, color(i)), and an off-diagonal entry (i, j) is
+    // B(i, color(j)) if j is the only neighbor of i with its color, else
+    // B(j, color(i)). Both (i, j) and (j, i) read the same entry of B, so the
+    // result is exactly symmetric.
+    for (Eigen::Index j = 0; j < hess.outerSize(); j++) {
+        for (Iterator it(hess, j); it; ++it) {
+            Eigen::Index row = std::min(it.row(), j);
+            Eigen::Index col = std::max(it.row(), j);
+            if (row != col && neighbor_counts.coeff(colors[col], row) != 1) {
+                std::swap(row, col);
+            }
+            it.valueRef() = compressed(row, colors[col]);
+        }
+    }
+}
+
+} // namespace fd
@@ -0,0 +1,224 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators_all.hpp>
+
+#include <Eigen/Core>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <finitediff_cache.hpp>
+
+using namespace fd;
+
+TEST_CASE("Test evaluation cache shared across calls", "[cache]")
+{
+    int n = GENERATE(1, 2, 10);
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        num_evals++;
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    const double eps = 1e-5;
+
+    Eigen::VectorXd grad, expected_grad;
+    Eigen::MatrixXd hess, expected_hess;
+    finite_gradient(x, f, expected_grad, accuracy, eps);
+    finite_hessian(x, f, expected_hess, accuracy, eps, 1, REDUCED_STENCIL);
+
+    EvaluationCache<> cache;
+    const auto cached_f = cache.wrap(f);
+
+    num_evals = 0;
+    finite_gradient(x, cached_f, grad, accuracy, eps);
+    CHECK(grad == expected_grad);
+    CHECK(cache.hits() == 0);
+    CHECK(cache.misses() == size_t(num_evals));
+
+    // The second derivative stencils on the diagonal of the reduced hessian
+    // reach the same points as the gradient.
+    finite_hessian(x, cached_f, hess, accuracy, eps, 1, REDUCED_STENCIL);
+    CHECK(hess == expected_hess);
+    CHECK(cache.hits() > 0);
+    CHECK(cache.misses() == size_t(num_evals));
+    CHECK(
+        cache.hits() + cache.misses()
+        == get_stencil(accuracy).size * n
+            + finite_hessian_num_evaluations(n, accuracy, REDUCED_STENCIL));
+
+    // Repeating a call is served entirely from the cache.
+    const int evals_before = num_evals;
+    finite_hessian(x, cached_f, hess, accuracy, eps, 2, REDUCED_STENCIL);
+    CHECK(hess == expected_hess);
+    CHECK(num_evals == evals_before);
+    CHECK(cache.size() == size_t(num_evals));
+
+    cache.clear();
+    CHECK(cache.size() == 0);
+    CHECK(cache.hits() == 0);
+    CHECK(cache.memory_usage() == 0);
+}
+
+TEST_CASE("Test evaluation cache memory cap", "[cache]")
+{
+    const int n = 10;
+    const auto f = [](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        return x.array().sin();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    EvaluationCache<Eigen::VectorXd> unlimited;
+    Eigen::MatrixXd jac, expected_jac;
+    finite_jacobian(x, unlimited.wrap(f), expected_jac);
+    const size_t full_bytes = unlimited.memory_usage();
+    CHECK(unlimited.size() == size_t(2 * n));
+    CHECK(unlimited.evictions() == 0);
+
+    EvaluationCache<Eigen::VectorXd> capped(full_bytes / 2);
+    finite_jacobian(x, capped.wrap(f), jac);
+    CHECK(jac == expected_jac);
+    CHECK(capped.memory_usage() <= capped.max_bytes());
+    CHECK(capped.evictions() > 0);
+    CHECK(capped.size() + capped.evictions() == size_t(2 * n));
+}
+
+TEST_CASE("Test evaluation store resumes interrupted runs", "[cache]")
+{
+    const int n = GENERATE(2, 10);
+    const char* path = "test_evaluation_store.bin";
+    std::remove(path);
+
+    int num_evals = 0, max_evals = -1;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        if (num_evals == max_evals) {
+            throw std::runtime_error("interrupted");
+        }
+        num_evals++;
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    Eigen::MatrixXd hess, expected_hess;
+    finite_hessian(x, f, expected_hess);
+    const int total_evals = num_evals;
+
+    // Interrupt the first run halfway through.
+    num_evals = 0;
+    max_evals = total_evals / 2;
+    {
+        EvaluationStore<> store(path);
+        CHECK_THROWS_AS(
+            finite_hessian(x, store.wrap(f), hess), std::runtime_error);
+        CHECK(store.size() == size_t(max_evals));
+    }
+
+    // Leave a truncated record, as from an interrupted write.
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out.write("\x03\x00", 2);
+    }
+
+    // The resumed run only performs the missing evaluations.
+    num_evals = 0;
+    max_evals = -1;
+    {
+        EvaluationStore<> store(path);
+        CHECK(store.size() == size_t(total_evals / 2));
+        finite_hessian(x, store.wrap(f), hess);
+        CHECK(hess == expected_hess);
+        CHECK(num_evals == total_evals - total_evals / 2);
+        CHECK(store.misses() == size_t(num_evals));
+    }
+
+    // A complete store serves every evaluation.
+    num_evals = 0;
+    {
+        EvaluationStore<> store(path);
+        CHECK(store.size() == size_t(total_evals));
+        finite_hessian(x, store.wrap(f), hess);
+        CHECK(hess == expected_hess);
+        CHECK(num_evals == 0);
+    }
+
+    // A store of scalar values cannot be opened as one of vector values.
+    CHECK_THROWS_AS(
+        EvaluationStore<Eigen::VectorXd> { path }, std::runtime_error);
+
+    std::remove(path);
+}
+
+TEST_CASE("Test evaluation store recovers an interrupted creation", "[cache]")
+{
+    // An empty file, or one holding only part of the header.
+    const std::string contents = GENERATE(
+        std::string(), std::string("fdst"), std::string("fdstord"));
+    const char* path = "test_cache_store_header.bin";
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    const auto f = [](const Eigen::VectorXd& x) -> double {
+        return x.squaredNorm();
+    };
+    const Eigen::VectorXd x = Eigen::VectorXd::Random(3);
+    {
+        EvaluationStore<> store(path);
+        CHECK(store.size() == 0);
+        CHECK(store.wrap(f)(x) == f(x));
+    }
+    {
+        EvaluationStore<> store(path);
+        CHECK(store.size() == 1);
+    }
+
+    // A short file that is not part of a store is not overwritten.
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write("abc", 3);
+    }
+    CHECK_THROWS_AS(EvaluationStore<> { path }, std::runtime_error);
+
+    std::remove(path);
+}
+
+TEST_CASE("Test evaluation store with a corrupted size", "[cache]")
+{
+    const char* path = "test_cache_store_size.bin";
+    std::remove(path);
+
+    const auto f = [](const Eigen::VectorXd& x) -> double {
+        return x.squaredNorm();
+    };
+    const Eigen::VectorXd x = Eigen::VectorXd::Random(3);
+    {
+        EvaluationStore<> store(path);
+        store.wrap(f)(x);
+    }
+
+    // A torn size field is treated as a truncated record instead of being
+    // allocated.
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        const int64_t size = int64_t(1) << 60;
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write("\x00\x00\x00\x00", 4);
+    }
+    {
+        EvaluationStore<> store(path);
+        CHECK(store.size() == 1);
+    }
+    {
+        EvaluationStore<> store(path);
+        CHECK(store.size() == 1);
+    }
+
+    std::remove(path);
+}
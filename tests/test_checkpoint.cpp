@@ -0,0 +1,217 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators_all.hpp>
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <finitediff_checkpoint.hpp>
+
+using namespace fd;
+
+TEST_CASE("Test resumable jacobian", "[jacobian][checkpoint]")
+{
+    const int n = GENERATE(1, 5, 10);
+    const Eigen::Index interval = GENERATE(1, 3);
+    const AccuracyOrder accuracy = GENERATE(SECOND, FOURTH);
+    const char* path = "test_checkpoint_jacobian.bin";
+    std::remove(path);
+
+    // The resumed runs evaluate f from several threads.
+    std::atomic<int> num_evals(0);
+    int max_evals = -1;
+    const auto f = [&](const Eigen::VectorXd& y) -> Eigen::VectorXd {
+        if (num_evals == max_evals) {
+            throw std::runtime_error("preempted");
+        }
+        num_evals++;
+        Eigen::VectorXd fy(2);
+        fy << y.array().sin().sum(), y.squaredNorm();
+        return fy;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    Eigen::MatrixXd jac, expected_jac;
+    finite_jacobian(x, f, expected_jac, accuracy);
+    const int total_evals = num_evals;
+
+    // Preempt the first run halfway through.
+    num_evals = 0;
+    max_evals = total_evals / 2;
+    CHECK_THROWS_AS(
+        finite_jacobian_resumable(
+            x, f, jac, path, accuracy, 1e-8, 1, interval),
+        std::runtime_error);
+
+    // Only the columns of the unfinished blocks are computed again.
+    const int stencil_size = int(get_stencil(accuracy).size);
+    const int completed_cols =
+        int(max_evals / (stencil_size * interval) * interval);
+    num_evals = 0;
+    max_evals = -1;
+    finite_jacobian_resumable(x, f, jac, path, accuracy, 1e-8, 2, interval);
+    CHECK(jac == expected_jac);
+    CHECK(num_evals == total_evals - completed_cols * stencil_size);
+
+    // A finished checkpoint holds the whole jacobian.
+    num_evals = 0;
+    finite_jacobian_resumable(x, f, jac, path, accuracy, 1e-8, 1, interval);
+    CHECK(jac == expected_jac);
+    CHECK(num_evals == 0);
+
+    // The checkpoint belongs to this computation only.
+    CHECK_THROWS_AS(
+        finite_jacobian_resumable(x, f, jac, path, accuracy, 1e-6),
+        std::runtime_error);
+
+    std::remove(path);
+}
+
+TEST_CASE("Test resumable hessian", "[hessian][checkpoint]")
+{
+    const int n = GENERATE(1, 5, 10);
+    const Eigen::Index interval = GENERATE(1, 4);
+    const AccuracyOrder accuracy = GENERATE(SECOND, SIXTH);
+    const HessianStencil stencil = GENERATE(FULL_STENCIL, REDUCED_STENCIL);
+    const char* path = "test_checkpoint_hessian.bin";
+    std::remove(path);
+
+    // The resumed runs evaluate f from several threads.
+    std::atomic<int> num_evals(0);
+    int max_evals = -1;
+    const auto f = [&](const Eigen::VectorXd& y) -> double {
+        if (num_evals == max_evals) {
+            throw std::runtime_error("preempted");
+        }
+        num_evals++;
+        return y.array().sin().matrix().squaredNorm() + y.prod();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    Eigen::MatrixXd hess, expected_hess;
+    finite_hessian(x, f, expected_hess, accuracy, 1e-5, 1, stencil);
+
+    // Each block of rows evaluates f(x) once, plus the entries of its rows:
+    // those of the trailing hessian of size n - begin not in the one of size
+    // n - end.
+    std::vector<int> block_evals;
+    for (Eigen::Index begin = 0; begin < n; begin += interval) {
+        const Eigen::Index end = std::min<Eigen::Index>(begin + interval, n);
+        block_evals.push_back(
+            int(finite_hessian_num_evaluations(n - begin, accuracy, stencil))
+            - int(finite_hessian_num_evaluations(n - end, accuracy, stencil))
+            + (end < n ? 1 : 0));
+    }
+    const int total_evals =
+        std::accumulate(block_evals.begin(), block_evals.end(), 0);
+
+    // Preempt the first run partway through.
+    num_evals = 0;
+    max_evals = total_evals / 2;
+    CHECK_THROWS_AS(
+        finite_hessian_resumable(
+            x, f, hess, path, accuracy, 1e-5, 1, stencil, interval),
+        std::runtime_error);
+
+    // Leave a truncated record, as from an interrupted write.
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out.write("\x01\x00\x00", 3);
+    }
+
+    // The preempted run finished the blocks that fit in max_evals.
+    int completed_evals = 0;
+    for (const int evals : block_evals) {
+        if (completed_evals + evals > max_evals) {
+            break;
+        }
+        completed_evals += evals;
+    }
+
+    // Only the rows of the unfinished blocks are computed again.
+    num_evals = 0;
+    max_evals = -1;
+    finite_hessian_resumable(
+        x, f, hess, path, accuracy, 1e-5, 2, stencil, interval);
+    CHECK(hess == expected_hess);
+    CHECK(num_evals == total_evals - completed_evals);
+
+    // A finished checkpoint holds the whole hessian.
+    num_evals = 0;
+    finite_hessian_resumable(
+        x, f, hess, path, accuracy, 1e-5, 1, stencil, interval);
+    CHECK(hess == expected_hess);
+    CHECK(num_evals == 0);
+
+    std::remove(path);
+}
+
+TEST_CASE(
+    "Test resumable derivatives recover an interrupted creation",
+    "[checkpoint]")
+{
+    // An empty file, or one holding only part of the magic string.
+    const std::string contents =
+        GENERATE(std::string(), std::string("fd"), std::string("fdhesck"));
+    const char* path = "test_checkpoint_header.bin";
+
+    const auto f = [](const Eigen::VectorXd& y) -> double {
+        return y.array().sin().matrix().squaredNorm() + y.prod();
+    };
+    const auto g = [](const Eigen::VectorXd& y) -> Eigen::VectorXd {
+        return y.array().sin();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(5);
+    Eigen::MatrixXd hess, expected_hess, jac, expected_jac;
+    finite_hessian(x, f, expected_hess, SECOND, 1e-5);
+    finite_jacobian(x, g, expected_jac, SECOND, 1e-8);
+
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+    finite_hessian_resumable(x, f, hess, path, SECOND, 1e-5, 1);
+    CHECK(hess == expected_hess);
+
+    // The recreated checkpoint is complete.
+    int num_evals = 0;
+    const auto counted_f = [&](const Eigen::VectorXd& y) -> double {
+        num_evals++;
+        return f(y);
+    };
+    finite_hessian_resumable(x, counted_f, hess, path, SECOND, 1e-5, 1);
+    CHECK(hess == expected_hess);
+    CHECK(num_evals == 0);
+    std::remove(path);
+
+    if (contents.size() <= 2) { // Also a prefix of the jacobian magic
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(contents.data(), contents.size());
+        }
+        finite_jacobian_resumable(x, g, jac, path, SECOND, 1e-8, 1);
+        CHECK(jac == expected_jac);
+        std::remove(path);
+    }
+
+    // A short file that is not part of a checkpoint is not overwritten.
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write("abc", 3);
+    }
+    CHECK_THROWS_AS(
+        finite_hessian_resumable(x, f, hess, path, SECOND, 1e-5, 1),
+        std::runtime_error);
+    std::remove(path);
+
+    // The header is written to a temporary file first.
+    CHECK(!std::ifstream(std::string(path) + ".tmp"));
+}
@@ -1,4 +1,6 @@
+#include <atomic>
 #include <iostream>
+#include <limits>
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators_all.hpp>
@@ -78,3 +80,177 @@ TEST_CASE("Test finite difference gradient of trig", "[gradient]")
 
     CHECK(compare_gradient(grad, fgrad));
 }
+
+TEST_CASE("Test multithreaded finite difference gradient", "[gradient]")
+{
+    int n = GENERATE(1, 3, 100);
+    unsigned num_threads = GENERATE(0u, 2u, 3u, 8u);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::VectorXd serial_grad, parallel_grad;
+    finite_gradient(x, f, serial_grad, accuracy);
+    finite_gradient(x, f, parallel_grad, accuracy, 1.0e-8, num_threads);
+
+    // The parallel path must be bit-identical to the serial path.
+    CHECK(serial_grad == parallel_grad);
+}
+
+TEST_CASE("Test batched finite difference gradient", "[gradient][batched]")
+{
+    int n = GENERATE(1, 2, 10);
+    size_t max_batch_size = GENERATE(0, 1, 7);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    int num_calls = 0;
+    const auto f_batched = [&](const Eigen::MatrixXd& X) -> Eigen::VectorXd {
+        num_calls++;
+        Eigen::VectorXd values(X.cols());
+        for (int i = 0; i < X.cols(); i++) {
+            values[i] = f(X.col(i));
+        }
+        return values;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::VectorXd grad, fgrad;
+    finite_gradient(x, f, grad, accuracy);
+    finite_gradient_batched(
+        x, f_batched, fgrad, accuracy, 1e-8, max_batch_size);
+
+    CHECK(grad == fgrad);
+    if (max_batch_size == 0) {
+        CHECK(num_calls == 1);
+    }
+}
+
+TEST_CASE("Test fixed-size finite difference gradient", "[gradient][fixed]")
+{
+    const auto f = [](const Eigen::Vector3d& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    Eigen::Vector3d x = Eigen::Vector3d::Random();
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::Vector3d fgrad;
+    finite_gradient(x, f, fgrad, accuracy);
+
+    Eigen::VectorXd grad;
+    finite_gradient(Eigen::VectorXd(x), f, grad, accuracy);
+
+    CHECK(grad == Eigen::VectorXd(fgrad));
+    CHECK(compare_gradient(
+        2 * x.array().sin() * x.array().cos(), Eigen::VectorXd(fgrad)));
+}
+
+TEST_CASE("Test finite difference stencil coefficients", "[gradient][stencil]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    const StencilCoeffs stencil = get_stencil(accuracy);
+
+    // The stencil of a first derivative annihilates constants and
+    // differentiates linear functions exactly.
+    double sum = 0, first_moment = 0;
+    for (size_t i = 0; i < stencil.size; i++) {
+        sum += stencil.external_coeffs[i];
+        first_moment += stencil.external_coeffs[i] * stencil.internal_coeffs[i];
+    }
+    CHECK(sum == 0);
+    CHECK(first_moment == stencil.denominator);
+}
+
+TEST_CASE("Test finite difference gradient step size", "[gradient][step]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    // Variables on very different scales: f(x) = Σ sin(xᵢ / sᵢ).
+    Eigen::VectorXd s(3);
+    s << 1e-6, 1, 1e6;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.cwiseQuotient(s).array().sin().sum();
+    };
+
+    const Eigen::VectorXd x = 0.5 * s;
+    const Eigen::VectorXd grad = x.cwiseQuotient(s).array().cos() / s.array();
+    const auto relative_error = [&](const Eigen::VectorXd& fgrad) {
+        return (fgrad - grad).cwiseQuotient(grad).cwiseAbs().maxCoeff();
+    };
+
+    // A single absolute step is too large for the smallest variable and lost
+    // in the round-off of the largest.
+    Eigen::VectorXd fgrad;
+    finite_gradient(x, f, fgrad, accuracy, 1e-8);
+    CHECK(relative_error(fgrad) > 1e-4);
+
+    Eigen::VectorXd absolute_grad;
+    finite_gradient(x, f, absolute_grad, accuracy, StepSize::absolute(1e-8));
+    CHECK(absolute_grad == fgrad);
+
+    finite_gradient(x, f, fgrad, accuracy, StepSize::relative(1e-8, s));
+    CHECK(relative_error(fgrad) < 1e-6);
+
+    const double noise = std::numeric_limits<double>::epsilon();
+    finite_gradient(x, f, fgrad, accuracy, StepSize::optimal(noise, s), 2);
+    CHECK(relative_error(fgrad) < 1e-6);
+
+    finite_gradient(x, f, fgrad, accuracy, StepSize::per_coordinate(1e-7 * s));
+    CHECK(relative_error(fgrad) < 1e-6);
+}
+
+TEST_CASE(
+    "Test extrapolated finite difference gradient", "[gradient][extrapolated]")
+{
+    int n = GENERATE(1, 3, 10);
+    unsigned num_threads = GENERATE(1u, 3u);
+
+    std::atomic<int> num_evals(0);
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        num_evals++;
+        return x.array().sin().sum() + x.array().exp().prod();
+    };
+
+    const Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(n, -1, 1);
+    const Eigen::VectorXd grad = x.array().cos() + x.array().exp().prod();
+
+    Eigen::VectorXd fgrad, error;
+    finite_gradient_extrapolated(
+        x, f, fgrad, error, StepSize::relative(0.1), 10, 0, num_threads);
+
+    // Far more accurate than a single second order difference, and within
+    // the error estimate up to round-off.
+    const Eigen::VectorXd actual_error = (fgrad - grad).cwiseAbs();
+    CHECK(actual_error.maxCoeff() < 1e-10);
+    CHECK((actual_error.array() <= 10 * error.array() + 1e-12).all());
+    CHECK((error.array() < 1e-9).all());
+
+    // The threads only share the coordinates.
+    Eigen::VectorXd serial_grad, serial_error;
+    num_evals = 0;
+    finite_gradient_extrapolated(x, f, serial_grad, serial_error);
+    CHECK(serial_grad == fgrad);
+    CHECK(serial_error == error);
+
+    // A loose tolerance stops after fewer steps.
+    const int full_evals = num_evals;
+    num_evals = 0;
+    finite_gradient_extrapolated(
+        x, f, fgrad, error, StepSize::relative(0.1), 10, 1e-4, num_threads);
+    CHECK(num_evals < full_evals);
+    CHECK((error.array() <= 1e-4).all());
+    CHECK(compare_gradient(grad, fgrad));
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <limits>
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators_all.hpp>
@@ -78,3 +79,401 @@ TEST_CASE("Test finite difference hessian of trig", "[hessian]")
 
     CHECK(compare_hessian(hess, fhess));
 }
+
+TEST_CASE("Test batched finite difference hessian", "[hessian][batched]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(1, 2, 10);
+    size_t max_batch_size = GENERATE(0, 1, 7);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    const auto f_batched = [&](const Eigen::MatrixXd& X) -> Eigen::VectorXd {
+        Eigen::VectorXd values(X.cols());
+        for (int i = 0; i < X.cols(); i++) {
+            values[i] = f(X.col(i));
+        }
+        return values;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd hess, fhess;
+    finite_hessian(x, f, hess, accuracy);
+    finite_hessian_batched(
+        x, f_batched, fhess, accuracy, 1e-5, max_batch_size);
+
+    CHECK(hess == fhess);
+}
+
+TEST_CASE(
+    "Test templated and std::function finite difference hessian agree",
+    "[hessian]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(1, 2, 10);
+
+    const auto f = [](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+    const std::function<double(const Eigen::VectorXd&)> f_erased = f;
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd hess, fhess;
+    finite_hessian(x, f, hess, accuracy);         // Inlined template
+    finite_hessian(x, f_erased, fhess, accuracy); // Compiled entry point
+
+    CHECK(hess == fhess);
+}
+
+TEST_CASE("Test fixed-size finite difference hessian", "[hessian][fixed]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    const auto f = [](const Eigen::Matrix<double, 6, 1>& x) -> double {
+        return x.array().sin().matrix().squaredNorm() + x[0] * x[5];
+    };
+
+    Eigen::Matrix<double, 6, 1> x = Eigen::Matrix<double, 6, 1>::Random();
+
+    Eigen::ArrayXd sin_x = x.array().sin(), cos_x = x.array().cos();
+    Eigen::MatrixXd hess = Eigen::MatrixXd::Zero(6, 6);
+    hess.diagonal() = 2 * (cos_x * cos_x) - 2 * (sin_x * sin_x);
+    hess(0, 5) = hess(5, 0) = 1;
+
+    Eigen::Matrix<double, 6, 6> fhess;
+    finite_hessian(x, f, fhess, accuracy);
+
+    CHECK(compare_hessian(hess, fhess));
+
+    Eigen::MatrixXd dynamic_hess;
+    finite_hessian(Eigen::VectorXd(x), f, dynamic_hess, accuracy);
+    CHECK(dynamic_hess == fhess);
+}
+
+TEST_CASE(
+    "Test finite difference hessian from gradient", "[hessian][gradient]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(1, 2, 4, 10, 25);
+
+    // f(x) = xᵀAx + bᵀx
+    Eigen::MatrixXd A = Eigen::MatrixXd::Random(n, n);
+    Eigen::VectorXd b = Eigen::VectorXd::Random(n);
+
+    int num_evals = 0;
+    const auto grad = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        num_evals++;
+        return A * x + A.transpose() * x + b;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd hess = A + A.transpose();
+
+    Eigen::MatrixXd fhess;
+    finite_hessian_from_gradient(x, grad, fhess, accuracy);
+
+    CHECK(compare_hessian(hess, fhess));
+    CHECK(fhess == fhess.transpose());
+    // The first stencil point of the jacobian sizes it, so the gradient is
+    // evaluated exactly once per stencil point.
+    CHECK(num_evals == n * int(get_stencil(accuracy).size));
+}
+
+TEST_CASE(
+    "Test finite difference hessian of Rosenbrock from gradient",
+    "[hessian][gradient]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    const auto grad = [](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        return Eigen::Vector2d(
+            -2 * (1 - x[0]) + 200 * (x[1] - x[0] * x[0]) * (-2 * x[0]),
+            200 * (x[1] - x[0] * x[0]));
+    };
+
+    Eigen::VectorXd x = Eigen::Vector2d::Random();
+
+    Eigen::MatrixXd hess(2, 2);
+    hess(0, 0) = 1200 * x[0] * x[0] - 400 * x[1] + 2;
+    hess(0, 1) = -400 * x[0];
+    hess(1, 0) = -400 * x[0];
+    hess(1, 1) = 200;
+
+    Eigen::MatrixXd fhess;
+    finite_hessian_from_gradient(x, grad, fhess, accuracy);
+
+    CHECK(compare_hessian(hess, fhess));
+}
+
+TEST_CASE("Test finite difference hessian-vector product", "[hessian][hvp]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(1, 2, 4, 10, 25);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm() + x.prod();
+    };
+    const auto grad = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        Eigen::VectorXd g = 2 * x.array().sin() * x.array().cos();
+        for (int i = 0; i < x.size(); i++) {
+            double prod = 1;
+            for (int j = 0; j < x.size(); j++) {
+                prod *= i == j ? 1 : x[j];
+            }
+            g[i] += prod;
+        }
+        return g;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    Eigen::MatrixXd V = Eigen::MatrixXd::Random(n, 3);
+
+    Eigen::MatrixXd hess;
+    finite_hessian_from_gradient(x, grad, hess, EIGHTH);
+
+    Eigen::VectorXd hv;
+    finite_hessian_vector_product(x, f, V.col(0), hv, accuracy);
+    CHECK(compare_gradient(hess * V.col(0), hv));
+
+    finite_hessian_vector_product_from_gradient(
+        x, grad, V.col(0), hv, accuracy);
+    CHECK(compare_gradient(hess * V.col(0), hv));
+
+    Eigen::MatrixXd HV;
+    finite_hessian_vector_product(x, f, V, HV, accuracy);
+    CHECK(compare_jacobian(hess * V, HV));
+
+    finite_hessian_vector_product_from_gradient(x, grad, V, HV, accuracy);
+    CHECK(compare_jacobian(hess * V, HV));
+}
+
+TEST_CASE("Test multithreaded finite difference hessian", "[hessian]")
+{
+    int n = GENERATE(0, 1, 3, 40);
+    unsigned num_threads = GENERATE(0u, 2u, 3u, 8u);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm() * x.sum();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH);
+
+    Eigen::MatrixXd serial_hess, parallel_hess;
+    finite_hessian(x, f, serial_hess, accuracy);
+    finite_hessian(x, f, parallel_hess, accuracy, 1.0e-5, num_threads);
+
+    // The parallel path must be bit-identical to the serial path.
+    CHECK(serial_hess == parallel_hess);
+}
+
+TEST_CASE(
+    "Test finite difference hessian evaluates each point once",
+    "[hessian][evals]")
+{
+    int n = GENERATE(0, 1, 2, 5);
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    // f(x) = xᵀAx + bᵀx
+    Eigen::MatrixXd A = Eigen::MatrixXd::Random(n, n);
+    A = (A + A.transpose()).eval();
+    Eigen::VectorXd b = Eigen::VectorXd::Random(n);
+
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        num_evals++;
+        return x.dot(A * x) + b.dot(x);
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd fhess;
+    finite_hessian(x, f, fhess, accuracy);
+    CHECK(compare_hessian(2 * A, fhess));
+
+    const size_t k = get_stencil(accuracy).size;
+    const size_t full_evals = size_t(n * (n + 1) / 2) * k * k;
+    CHECK(size_t(num_evals) == finite_hessian_num_evaluations(n, accuracy));
+    if (n > 0) {
+        CHECK(size_t(num_evals) < full_evals);
+    }
+}
+
+TEST_CASE("Test reduced finite difference hessian stencil", "[hessian]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(1, 2, 5);
+
+    // f(x) = exp(aᵀx), ∇²f(x) = a aᵀ exp(aᵀx). With |aᵢ| >= 1 the truncation
+    // error dominates the round-off, so the orders of accuracy can be told
+    // apart.
+    Eigen::VectorXd a = Eigen::VectorXd::Random(n);
+    a += a.cwiseSign();
+
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        num_evals++;
+        return std::exp(a.dot(x));
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    Eigen::MatrixXd hess = a * a.transpose() * std::exp(a.dot(x));
+
+    Eigen::MatrixXd fhess;
+    finite_hessian(x, f, fhess, accuracy, 1e-3, 1, REDUCED_STENCIL);
+    CHECK(compare_hessian(hess, fhess));
+    CHECK(
+        size_t(num_evals)
+        == finite_hessian_num_evaluations(n, accuracy, REDUCED_STENCIL));
+
+    // The error shrinks with the order of accuracy, as for the full stencil.
+    if (accuracy != SECOND) {
+        Eigen::MatrixXd fhess2;
+        finite_hessian(x, f, fhess2, SECOND, 1e-3, 1, REDUCED_STENCIL);
+        CHECK((fhess - hess).norm() < (fhess2 - hess).norm());
+    }
+
+    const size_t k = get_stencil(accuracy).size;
+    if (n > 1 && k > 2) {
+        CHECK(
+            finite_hessian_num_evaluations(n, accuracy, REDUCED_STENCIL)
+            < finite_hessian_num_evaluations(n, accuracy, FULL_STENCIL));
+    }
+
+    if (n == 2) {
+        Eigen::Vector2d x2 = x;
+        Eigen::Matrix2d fhess_fixed;
+        finite_hessian(x2, f, fhess_fixed, accuracy, 1e-3, REDUCED_STENCIL);
+        CHECK(fhess_fixed.isApprox(fhess));
+    }
+}
+
+TEST_CASE("Test finite difference hessian diagonal", "[hessian][diagonal]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(0, 1, 2, 10);
+
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        num_evals++;
+        return x.array().sin().matrix().squaredNorm() + x.prod();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::ArrayXd sin_x = x.array().sin(), cos_x = x.array().cos();
+    Eigen::VectorXd diag = 2 * (cos_x * cos_x) - 2 * (sin_x * sin_x);
+
+    Eigen::VectorXd fdiag;
+    finite_hessian_diagonal(x, f, fdiag, accuracy);
+    CHECK(compare_gradient(diag, fdiag));
+
+    const int k = int(get_stencil(accuracy).size);
+    CHECK(num_evals == (n > 0 ? n * k + 1 : 0));
+
+    Eigen::VectorXd parallel_fdiag;
+    finite_hessian_diagonal(x, f, parallel_fdiag, accuracy, 1e-5, 3);
+    CHECK(fdiag == parallel_fdiag);
+}
+
+TEST_CASE("Test banded finite difference hessian", "[hessian][banded]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH);
+    int n = GENERATE(1, 2, 10);
+    int bandwidth = GENERATE(0, 1, 3, 20);
+    unsigned num_threads = GENERATE(1u, 3u);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm() * x.sum();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd fhess, fhess_banded;
+    finite_hessian(x, f, fhess, accuracy);
+    finite_hessian_banded(
+        x, f, bandwidth, fhess_banded, accuracy, 1e-5, num_threads);
+
+    REQUIRE(fhess_banded.rows() == n);
+    REQUIRE(fhess_banded.cols() == n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            CHECK(
+                fhess_banded(i, j)
+                == (std::abs(i - j) <= bandwidth ? fhess(i, j) : 0.0));
+        }
+    }
+}
+
+TEST_CASE("Test packed finite difference hessian", "[hessian][packed]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(0, 1, 2, 10);
+    unsigned num_threads = GENERATE(1u, 3u);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm() * x.sum();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd fhess;
+    finite_hessian(x, f, fhess, accuracy);
+
+    Eigen::VectorXd packed;
+    finite_hessian_packed(x, f, packed, accuracy, 1e-5, num_threads);
+
+    REQUIRE(packed.size() == n * (n + 1) / 2);
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i <= j; i++) {
+            CHECK(packed[i + j * (j + 1) / 2] == fhess(i, j));
+        }
+    }
+}
+
+TEST_CASE("Test finite difference hessian step size", "[hessian][step]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    HessianStencil stencil = GENERATE(FULL_STENCIL, REDUCED_STENCIL);
+
+    // f(x) = Σ sin(yᵢ) + y₀ y₂ with y = x / s.
+    Eigen::Vector3d s(1e-3, 1, 1e3);
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        const Eigen::VectorXd y = x.cwiseQuotient(s);
+        return y.array().sin().sum() + y[0] * y[2];
+    };
+
+    const Eigen::VectorXd x = 0.5 * s;
+    // Hessian of f with respect to y, i.e. s H s.
+    Eigen::Matrix3d scaled_hess = Eigen::Matrix3d::Zero();
+    scaled_hess.diagonal().setConstant(-std::sin(0.5));
+    scaled_hess(0, 2) = scaled_hess(2, 0) = 1;
+
+    const double noise = std::numeric_limits<double>::epsilon();
+    Eigen::MatrixXd fhess;
+    finite_hessian(
+        x, f, fhess, accuracy, StepSize::optimal(noise, s), 1, stencil);
+    CHECK(compare_hessian(
+        scaled_hess, s.asDiagonal() * fhess * s.asDiagonal()));
+
+    // The policy is the same with steps given per coordinate.
+    Eigen::MatrixXd coordinate_hess;
+    finite_hessian(
+        x, f, coordinate_hess, accuracy,
+        StepSize::per_coordinate(
+            StepSize::optimal(noise, s).steps(x, accuracy, 2)),
+        2, stencil);
+    CHECK(coordinate_hess == fhess);
+
+    Eigen::MatrixXd expected_hess;
+    finite_hessian(x, f, expected_hess, accuracy, 1e-5, 1, stencil);
+    finite_hessian(
+        x, f, fhess, accuracy, StepSize::absolute(1e-5), 3, stencil);
+    CHECK(fhess == expected_hess);
+}
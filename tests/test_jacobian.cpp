@@ -51,3 +51,234 @@ TEST_CASE("Test finite difference jacobian of trig", "[jacobian]")
 
     CHECK(compare_jacobian(jac, fjac));
 }
+
+TEST_CASE("Test batched finite difference jacobian", "[jacobian][batched]")
+{
+    int n = GENERATE(1, 2, 10);
+    size_t max_batch_size = GENERATE(0, 1, 7);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        Eigen::VectorXd fx(x.size() + 1);
+        fx << x.array().sin(), x.squaredNorm();
+        return fx;
+    };
+
+    const auto f_batched = [&](const Eigen::MatrixXd& X) -> Eigen::MatrixXd {
+        Eigen::MatrixXd values(X.rows() + 1, X.cols());
+        for (int i = 0; i < X.cols(); i++) {
+            values.col(i) = f(X.col(i));
+        }
+        return values;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::MatrixXd jac, fjac;
+    finite_jacobian(x, f, jac, accuracy);
+    finite_jacobian_batched(
+        x, f_batched, fjac, accuracy, 1e-8, max_batch_size);
+
+    CHECK(jac == fjac);
+}
+
+TEST_CASE(
+    "Test templated and std::function finite difference jacobian agree",
+    "[jacobian]")
+{
+    int n = GENERATE(1, 2, 10);
+
+    const auto f = [](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        return x.array().sin();
+    };
+    const std::function<Eigen::VectorXd(const Eigen::VectorXd&)> f_erased = f;
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::MatrixXd jac, fjac;
+    finite_jacobian(x, f, jac, accuracy);        // Inlined template
+    finite_jacobian(x, f_erased, fjac, accuracy); // Compiled entry point
+
+    CHECK(jac == fjac);
+}
+
+TEST_CASE("Test fixed-size finite difference jacobian", "[jacobian][fixed]")
+{
+    const auto f = [](const Eigen::Vector3d& x) -> Eigen::Vector2d {
+        return Eigen::Vector2d(x.squaredNorm(), std::sin(x[0]) * x[2]);
+    };
+
+    Eigen::Vector3d x = Eigen::Vector3d::Random();
+
+    Eigen::Matrix<double, 2, 3> jac;
+    jac.row(0) = 2 * x.transpose();
+    jac.row(1) << std::cos(x[0]) * x[2], 0, std::sin(x[0]);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::Matrix<double, 2, 3> fjac;
+    finite_jacobian(x, f, fjac, accuracy);
+    CHECK(compare_jacobian(jac, fjac));
+
+    // A dynamic number of outputs is also supported.
+    Eigen::Matrix<double, Eigen::Dynamic, 3> fjac_dynamic;
+    finite_jacobian(x, f, fjac_dynamic, accuracy);
+    CHECK(fjac == fjac_dynamic);
+}
+
+TEST_CASE(
+    "Test finite difference jacobian-vector product", "[jacobian][jvp]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(1, 2, 4, 10, 100);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        Eigen::VectorXd fx(x.size() + 1);
+        fx.head(x.size()) = x.array().sin();
+        fx[x.size()] = x.squaredNorm();
+        return fx;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+    Eigen::VectorXd v = Eigen::VectorXd::Random(n);
+
+    int num_evals = 0;
+    const auto counted_f = [&](const Eigen::VectorXd& y) -> Eigen::VectorXd {
+        num_evals++;
+        return f(y);
+    };
+
+    Eigen::MatrixXd fjac;
+    finite_jacobian(x, f, fjac, accuracy);
+
+    Eigen::VectorXd jv;
+    finite_jacobian_vector_product(x, counted_f, v, jv, accuracy);
+    CHECK(compare_gradient(fjac * v, jv));
+    CHECK(num_evals == int(get_stencil(accuracy).size));
+
+    const auto g = [&](const Eigen::VectorXd& y) -> double {
+        return f(y).sum();
+    };
+    Eigen::VectorXd fgrad;
+    finite_gradient(x, g, fgrad, accuracy);
+
+    const double derivative = finite_directional_derivative(x, g, v, accuracy);
+    CHECK(std::abs(derivative - fgrad.dot(v)) <= 1e-4 * (1 + fgrad.norm()));
+}
+
+TEST_CASE(
+    "Test finite difference jacobian evaluation count", "[jacobian][evals]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    int n = GENERATE(0, 1, 2, 4, 10);
+
+    Eigen::MatrixXd A = Eigen::MatrixXd::Random(n + 2, n);
+
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        num_evals++;
+        return A * x;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd fjac;
+    finite_jacobian(x, f, fjac, accuracy);
+    CHECK(fjac.rows() == n + 2);
+    CHECK(compare_jacobian(A, fjac));
+    CHECK(num_evals == std::max(n * int(get_stencil(accuracy).size), 1));
+
+    num_evals = 0;
+    Eigen::VectorXd fx;
+    finite_jacobian(x, f, fjac, fx, accuracy);
+    CHECK(compare_jacobian(A, fjac));
+    CHECK(fx.isApprox(A * x));
+    CHECK(num_evals == n * int(get_stencil(accuracy).size) + 1);
+}
+
+TEST_CASE("Test multithreaded finite difference jacobian", "[jacobian]")
+{
+    int n = GENERATE(1, 3, 100);
+    unsigned num_threads = GENERATE(0u, 2u, 3u, 8u);
+
+    const auto f = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        return x.array().sin() * x.sum();
+    };
+    const auto f_in_place = [&](const Eigen::VectorXd& x,
+                                Eigen::Ref<Eigen::VectorXd> fx) {
+        fx = x.array().sin() * x.sum();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::MatrixXd serial_jac, parallel_jac;
+    finite_jacobian(x, f, serial_jac, accuracy);
+    finite_jacobian(x, f, parallel_jac, accuracy, 1.0e-8, num_threads);
+
+    // The parallel path must be bit-identical to the serial path.
+    CHECK(serial_jac == parallel_jac);
+
+    finite_jacobian(
+        x, f_in_place, n, parallel_jac, accuracy, 1.0e-8, num_threads);
+    CHECK(serial_jac == parallel_jac);
+}
+
+TEST_CASE("Test finite difference jacobian step size", "[jacobian][step]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    // f(x) = (sin(x₀ / s₀ + x₁ / s₁), cos(x₁ / s₁)) with s = (1e-6, 1e6).
+    Eigen::Vector2d s(1e-6, 1e6);
+    const auto f = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        const Eigen::VectorXd y = x.cwiseQuotient(s);
+        return Eigen::Vector2d(std::sin(y[0] + y[1]), std::cos(y[1]));
+    };
+
+    const Eigen::VectorXd x = 0.5 * s;
+    Eigen::Matrix2d jac;
+    jac << std::cos(1.0) / s[0], std::cos(1.0) / s[1], //
+        0, -std::sin(0.5) / s[1];
+
+    Eigen::MatrixXd fjac;
+    finite_jacobian(x, f, fjac, accuracy, StepSize::relative(1e-8, s));
+    // Scale the columns to compare entries of different magnitudes.
+    CHECK(compare_jacobian(jac * s.asDiagonal(), fjac * s.asDiagonal()));
+
+    Eigen::MatrixXd expected_jac;
+    finite_jacobian(x, f, expected_jac, accuracy, 1e-8);
+    finite_jacobian(x, f, fjac, accuracy, StepSize::absolute(1e-8), 2);
+    CHECK(fjac == expected_jac);
+}
+
+TEST_CASE(
+    "Test extrapolated finite difference jacobian", "[jacobian][extrapolated]")
+{
+    int n = GENERATE(0, 1, 3, 10);
+
+    const auto f = [](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        Eigen::VectorXd fx(2);
+        fx << x.array().sin().sum(), x.array().exp().sum();
+        return fx;
+    };
+
+    const Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(n, -1, 1);
+    Eigen::MatrixXd jac(2, n);
+    jac.row(0) = x.array().cos().transpose();
+    jac.row(1) = x.array().exp().transpose();
+
+    Eigen::MatrixXd fjac, error;
+    finite_jacobian_extrapolated(x, f, fjac, error);
+    REQUIRE(fjac.rows() == 2);
+    REQUIRE(fjac.cols() == n);
+    REQUIRE(error.rows() == 2);
+    REQUIRE(error.cols() == n);
+
+    const Eigen::MatrixXd actual_error = (fjac - jac).cwiseAbs();
+    CHECK((actual_error.array() < 1e-10).all());
+    CHECK((actual_error.array() <= 10 * error.array() + 1e-12).all());
+}
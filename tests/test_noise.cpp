@@ -0,0 +1,82 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators_all.hpp>
+
+#include <Eigen/Core>
+
+#include <random>
+
+#include <finitediff_noise.hpp>
+
+using namespace fd;
+
+TEST_CASE("Test noise estimate", "[noise]")
+{
+    const double sigma = GENERATE(1e-10, 1e-6);
+
+    std::mt19937 generator(0);
+    std::normal_distribution<double> noise(0, sigma);
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().sum() + noise(generator);
+    };
+
+    const Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(5, 0.1, 1);
+    const Eigen::VectorXd direction = Eigen::VectorXd::Ones(5).normalized();
+
+    const NoiseEstimate estimate = estimate_noise(x, f, direction, 1e-4);
+    CHECK(estimate.status == NOISE_DETECTED);
+    CHECK(estimate.noise > sigma / 4);
+    CHECK(estimate.noise < sigma * 4);
+
+    // Points so close that the values agree in every bit reveal nothing.
+    const auto smooth = [](const Eigen::VectorXd& y) -> double {
+        return y.squaredNorm();
+    };
+    CHECK(
+        estimate_noise(x, smooth, direction, 1e-20).status
+        == NOISE_SPACING_TOO_SMALL);
+    CHECK(
+        estimate_noise(x, smooth, direction, 1).status
+        == NOISE_SPACING_TOO_LARGE);
+}
+
+TEST_CASE("Test noise adaptive finite difference gradient", "[noise]")
+{
+    const int n = GENERATE(1, 5);
+
+    std::mt19937 generator(0);
+    std::normal_distribution<double> noise(0, 1e-10);
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        num_evals++;
+        return x.array().sin().sum() + noise(generator);
+    };
+
+    const Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(n, 0.1, 1);
+    const Eigen::VectorXd grad = x.array().cos();
+    const auto max_error = [&](const Eigen::VectorXd& fgrad) {
+        return (fgrad - grad).cwiseAbs().maxCoeff();
+    };
+
+    // The default step amplifies the noise by 1 / eps.
+    Eigen::VectorXd fgrad;
+    finite_gradient(x, f, fgrad);
+    CHECK(max_error(fgrad) > 1e-4);
+
+    NoiseAdaptiveStep step;
+    num_evals = 0;
+    finite_gradient(x, f, fgrad, SECOND, step.step_size(x, f));
+    REQUIRE(step.has_estimate());
+    CHECK(step.estimate().status == NOISE_DETECTED);
+    CHECK(max_error(fgrad) < 1e-5);
+    const int first_evals = num_evals;
+
+    // Later iterations reuse the estimate.
+    num_evals = 0;
+    finite_gradient(x, f, fgrad, FOURTH, step.step_size(x, f));
+    CHECK(num_evals == 4 * n);
+    CHECK(first_evals > 2 * n);
+    CHECK(max_error(fgrad) < 1e-5);
+
+    step.reset();
+    CHECK(!step.has_estimate());
+}
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators_all.hpp>
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+#include <finitediff_sparse.hpp>
+
+using namespace fd;
+
+namespace {
+// Tridiagonal pattern of an n × n matrix.
+Eigen::SparseMatrix<double> tridiagonal_pattern(int n)
+{
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (int i = 0; i < n; i++) {
+        for (int j = std::max(i - 1, 0); j <= std::min(i + 1, n - 1); j++) {
+            triplets.emplace_back(i, j, 1.0);
+        }
+    }
+    Eigen::SparseMatrix<double> pattern(n, n);
+    pattern.setFromTriplets(triplets.begin(), triplets.end());
+    return pattern;
+}
+} // namespace
+
+TEST_CASE("Test column coloring", "[sparse][coloring]")
+{
+    int n = GENERATE(1, 2, 3, 10, 100);
+
+    const Eigen::SparseMatrix<double> pattern = tridiagonal_pattern(n);
+
+    int num_colors;
+    const std::vector<int> colors = color_columns(pattern, num_colors);
+
+    CHECK(num_colors == std::min(n, 3));
+
+    // No two columns of the same color share a row.
+    const Eigen::MatrixXd dense = Eigen::MatrixXd(pattern);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            for (int k = j + 1; k < n; k++) {
+                if (dense(i, j) != 0 && dense(i, k) != 0) {
+                    CHECK(colors[j] != colors[k]);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test finite difference sparse jacobian", "[sparse][jacobian]")
+{
+    int n = GENERATE(1, 2, 10, 100);
+
+    // f_i(x) = sin(x_{i-1}) x_i + x_{i+1}²
+    int num_evals = 0;
+    const auto f = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        num_evals++;
+        Eigen::VectorXd fx(x.size());
+        for (int i = 0; i < x.size(); i++) {
+            fx[i] = (i > 0 ? std::sin(x[i - 1]) : 1.0) * x[i]
+                + (i + 1 < x.size() ? x[i + 1] * x[i + 1] : 0.0);
+        }
+        return fx;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    Eigen::MatrixXd jac;
+    finite_jacobian(x, f, jac, accuracy);
+
+    num_evals = 0;
+    Eigen::SparseMatrix<double> fjac;
+    finite_sparse_jacobian(x, f, tridiagonal_pattern(n), fjac, accuracy);
+
+    CHECK(compare_jacobian(jac, Eigen::MatrixXd(fjac)));
+    CHECK(fjac.nonZeros() == tridiagonal_pattern(n).nonZeros());
+    CHECK(num_evals == std::min(n, 3) * int(get_stencil(accuracy).size));
+}
+
+namespace {
+// Symmetric pattern with nonzeros where |i - j| <= bandwidth or at random.
+Eigen::SparseMatrix<double>
+symmetric_pattern(int n, int bandwidth, int num_random)
+{
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (int i = 0; i < n; i++) {
+        for (int j = std::max(i - bandwidth, 0);
+             j <= std::min(i + bandwidth, n - 1); j++) {
+            triplets.emplace_back(i, j, 1.0);
+        }
+    }
+    for (int k = 0; k < num_random && n > 0; k++) {
+        const int i = std::rand() % n, j = std::rand() % n;
+        triplets.emplace_back(i, j, 1.0);
+        triplets.emplace_back(j, i, 1.0);
+    }
+    Eigen::SparseMatrix<double> pattern(n, n);
+    pattern.setFromTriplets(triplets.begin(), triplets.end());
+    return pattern;
+}
+} // namespace
+
+TEST_CASE("Test star coloring", "[sparse][coloring]")
+{
+    int n = GENERATE(1, 2, 10, 50);
+    int bandwidth = GENERATE(0, 1, 2);
+    int num_random = GENERATE(0, 10);
+
+    const Eigen::SparseMatrix<double> pattern =
+        symmetric_pattern(n, bandwidth, num_random);
+    const Eigen::MatrixXd A = Eigen::MatrixXd(pattern);
+
+    int num_colors;
+    const std::vector<int> colors = star_color_columns(pattern, num_colors);
+
+    // Adjacent columns have different colors, and no path of four columns is
+    // bicolored.
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (i == j || A(i, j) == 0) {
+                continue;
+            }
+            CHECK(colors[i] != colors[j]);
+            for (int k = 0; k < n; k++) {
+                if (k == i || k == j || A(j, k) == 0
+                    || colors[k] != colors[i]) {
+                    continue;
+                }
+                for (int l = 0; l < n; l++) {
+                    if (l != i && l != j && l != k && A(k, l) != 0) {
+                        CHECK(colors[l] != colors[j]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Test finite difference sparse hessian", "[sparse][hessian]")
+{
+    int n = GENERATE(1, 2, 10, 50);
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    // f(x) = Σ sin(xᵢ) xᵢ₊₁ + xᵢ² xᵢ₊₂
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        double fx = 0;
+        for (int i = 0; i < x.size(); i++) {
+            if (i + 1 < x.size()) {
+                fx += std::sin(x[i]) * x[i + 1];
+            }
+            if (i + 2 < x.size()) {
+                fx += x[i] * x[i] * x[i + 2];
+            }
+        }
+        return fx;
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    const Eigen::SparseMatrix<double> pattern = symmetric_pattern(n, 2, 0);
+
+    Eigen::MatrixXd hess;
+    finite_hessian(x, f, hess, accuracy);
+
+    Eigen::SparseMatrix<double> fhess;
+    finite_sparse_hessian(x, f, pattern, fhess, accuracy);
+
+    CHECK(fhess.nonZeros() == pattern.nonZeros());
+    CHECK(compare_hessian(hess, Eigen::MatrixXd(fhess)));
+    CHECK(Eigen::MatrixXd(fhess) == Eigen::MatrixXd(fhess).transpose());
+}
+
+TEST_CASE(
+    "Test finite difference sparse hessian of quadratic", "[sparse][hessian]")
+{
+    int n = GENERATE(10, 50);
+    int num_random = GENERATE(0, 10, 50);
+
+    // f(x) = ½ xᵀAx with A having a random symmetric pattern.
+    Eigen::SparseMatrix<double> A = symmetric_pattern(n, 1, num_random);
+    for (int j = 0; j < A.outerSize(); j++) {
+        for (Eigen::SparseMatrix<double>::InnerIterator it(A, j); it; ++it) {
+            it.valueRef() = std::cos(double(it.row() * n + j))
+                + std::cos(double(j * n + it.row()));
+        }
+    }
+
+    const auto f = [&](const Eigen::VectorXd& x) -> double {
+        return 0.5 * x.dot(A * x);
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::SparseMatrix<double> fhess;
+    finite_sparse_hessian(x, f, A, fhess);
+
+    CHECK(compare_hessian(Eigen::MatrixXd(A), Eigen::MatrixXd(fhess)));
+}
+
+TEST_CASE(
+    "Test finite difference sparse hessian from gradient", "[sparse][hessian]")
+{
+    int n = GENERATE(1, 2, 10, 50);
+    int num_random = GENERATE(0, 10);
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    // f(x) = ½ xᵀAx + Σ cos(xᵢ) with A having a random symmetric pattern.
+    Eigen::SparseMatrix<double> A = symmetric_pattern(n, 2, num_random);
+    for (int j = 0; j < A.outerSize(); j++) {
+        for (Eigen::SparseMatrix<double>::InnerIterator it(A, j); it; ++it) {
+            it.valueRef() = std::cos(double(it.row() * n + j))
+                + std::cos(double(j * n + it.row()));
+        }
+    }
+
+    int num_evals = 0;
+    const auto grad = [&](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        num_evals++;
+        return A * x - x.array().sin().matrix();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd hess = Eigen::MatrixXd(A);
+    hess.diagonal() -= x.array().cos().matrix();
+
+    int num_colors;
+    const std::vector<int> colors = star_color_columns(A, num_colors);
+
+    Eigen::SparseMatrix<double> fhess;
+    finite_sparse_hessian_from_gradient(
+        x, grad, A, colors, num_colors, fhess, accuracy);
+
+    CHECK(fhess.nonZeros() == A.nonZeros());
+    CHECK(compare_hessian(hess, Eigen::MatrixXd(fhess)));
+    CHECK(Eigen::MatrixXd(fhess) == Eigen::MatrixXd(fhess).transpose());
+
+    // The gradient is evaluated once per stencil point of each color,
+    // regardless of the number of nonzeros.
+    CHECK(num_evals == num_colors * int(get_stencil(accuracy).size));
+    if (num_random == 0) {
+        // A pentadiagonal pattern is star colored with at most 5 colors.
+        CHECK(num_colors <= 5);
+    }
+}
@@ -0,0 +1,166 @@
+// Built with EIGEN_RUNTIME_NO_MALLOC defined for the whole executable, so
+// Eigen asserts if it allocates while set_is_malloc_allowed(false).
+#ifndef EIGEN_RUNTIME_NO_MALLOC
+#error "test_workspace.cpp requires EIGEN_RUNTIME_NO_MALLOC"
+#endif
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators_all.hpp>
+
+#include <Eigen/Core>
+
+#include <finitediff.hpp>
+
+using namespace fd;
+
+TEST_CASE("Test workspace reuse does not allocate", "[workspace]")
+{
+    int n = GENERATE(1, 10, 100);
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    const auto f = [](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Workspace workspace;
+    Eigen::VectorXd grad, expected_grad;
+    Eigen::MatrixXd hess, expected_hess;
+    finite_gradient(x, f, expected_grad, accuracy);
+    finite_hessian(x, f, expected_hess, accuracy);
+
+    // The first calls size the workspace and outputs.
+    finite_gradient(x, f, grad, workspace, accuracy);
+    finite_hessian(x, f, hess, workspace, accuracy);
+
+    Eigen::VectorXd y = -x;
+    Eigen::internal::set_is_malloc_allowed(false);
+    finite_gradient(y, f, grad, workspace, accuracy);
+    finite_gradient(x, f, grad, workspace, accuracy);
+    finite_hessian(x, f, hess, workspace, accuracy);
+    Eigen::internal::set_is_malloc_allowed(true);
+
+    CHECK(grad == expected_grad);
+    CHECK(hess == expected_hess);
+}
+
+TEST_CASE("Test workspace with multiple threads", "[workspace]")
+{
+    int n = GENERATE(1, 10, 100);
+    unsigned num_threads = GENERATE(1u, 2u, 4u);
+
+    const auto f = [](const Eigen::VectorXd& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Workspace workspace(n, num_threads);
+    Eigen::VectorXd grad, fgrad;
+    finite_gradient(x, f, grad);
+    finite_gradient(x, f, fgrad, workspace, SECOND, 1e-8, num_threads);
+    CHECK(grad == fgrad);
+
+    // Reusing the workspace with a different size resizes the buffers.
+    x = Eigen::VectorXd::Random(n + 1);
+    finite_gradient(x, f, grad);
+    finite_gradient(x, f, fgrad, workspace, SECOND, 1e-8, num_threads);
+    CHECK(grad == fgrad);
+
+    const auto g = [](const Eigen::VectorXd& y) -> Eigen::VectorXd {
+        return y.array().sin();
+    };
+    Eigen::MatrixXd jac, fjac;
+    finite_jacobian(x, g, jac);
+    finite_jacobian(x, g, fjac, workspace);
+    CHECK(jac == fjac);
+}
+
+TEST_CASE("Test in-place jacobian does not allocate", "[workspace][jacobian]")
+{
+    int n = GENERATE(1, 10, 100);
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+
+    const auto f = [](const Eigen::VectorXd& x) -> Eigen::VectorXd {
+        Eigen::VectorXd fx(x.size() + 1);
+        fx.head(x.size()) = x.array().sin();
+        fx[x.size()] = x.squaredNorm();
+        return fx;
+    };
+    const auto f_in_place = [](const Eigen::VectorXd& x,
+                               Eigen::Ref<Eigen::VectorXd> fx) {
+        fx.head(x.size()) = x.array().sin();
+        fx[x.size()] = x.squaredNorm();
+    };
+
+    Eigen::VectorXd x = Eigen::VectorXd::Random(n);
+
+    Eigen::MatrixXd jac, expected_jac;
+    finite_jacobian(x, f, expected_jac, accuracy);
+
+    Workspace workspace;
+    finite_jacobian(x, f_in_place, n + 1, jac, workspace, accuracy);
+    CHECK(jac == expected_jac);
+
+    Eigen::internal::set_is_malloc_allowed(false);
+    finite_jacobian(x, f_in_place, n + 1, jac, workspace, accuracy);
+    Eigen::internal::set_is_malloc_allowed(true);
+
+    CHECK(jac == expected_jac);
+}
+
+namespace {
+// Check that the fixed-size overloads do not allocate and agree with the
+// dynamic-size ones.
+template <int N>
+void check_fixed_size_does_not_allocate(
+    const AccuracyOrder accuracy, const HessianStencil stencil)
+{
+    typedef Eigen::Matrix<double, N, 1> Vector;
+    typedef Eigen::Matrix<double, N, N> Matrix;
+
+    const auto f = [](const Vector& x) -> double {
+        return x.array().sin().matrix().squaredNorm();
+    };
+    const auto g = [](const Vector& x) -> Vector { return x.array().sin(); };
+
+    const Vector x = Vector::Random();
+
+    Vector grad;
+    Matrix jac, hess;
+    Eigen::internal::set_is_malloc_allowed(false);
+    finite_gradient(x, f, grad, accuracy);
+    finite_jacobian(x, g, jac, accuracy);
+    finite_hessian(x, f, hess, accuracy, 1e-5, stencil);
+    Eigen::internal::set_is_malloc_allowed(true);
+
+    const auto f_dynamic = [](const Eigen::VectorXd& y) -> double {
+        return y.array().sin().matrix().squaredNorm();
+    };
+    const auto g_dynamic = [](const Eigen::VectorXd& y) -> Eigen::VectorXd {
+        return y.array().sin();
+    };
+    const Eigen::VectorXd x_dynamic = x;
+    Eigen::VectorXd expected_grad;
+    Eigen::MatrixXd expected_jac, expected_hess;
+    finite_gradient(x_dynamic, f_dynamic, expected_grad, accuracy);
+    finite_jacobian(x_dynamic, g_dynamic, expected_jac, accuracy);
+    finite_hessian(
+        x_dynamic, f_dynamic, expected_hess, accuracy, 1e-5, 1, stencil);
+
+    CHECK(compare_gradient(expected_grad, grad));
+    CHECK(compare_jacobian(expected_jac, jac));
+    CHECK(compare_hessian(expected_hess, hess));
+}
+} // namespace
+
+TEST_CASE("Test fixed-size derivatives do not allocate", "[workspace]")
+{
+    AccuracyOrder accuracy = GENERATE(SECOND, FOURTH, SIXTH, EIGHTH);
+    HessianStencil stencil = GENERATE(FULL_STENCIL, REDUCED_STENCIL);
+
+    check_fixed_size_does_not_allocate<3>(accuracy, stencil);
+    check_fixed_size_does_not_allocate<6>(accuracy, stencil);
+    check_fixed_size_does_not_allocate<12>(accuracy, stencil);
+}